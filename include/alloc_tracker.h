@@ -0,0 +1,310 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// AllocTracker - Cuenta de asignaciones de memoria por etapa y por ruta
+// ============================================================================
+//
+// Opcional, al compilar (-DHIVA_TRACK_ALLOCS, opción PRINTAGENT_TRACK_ALLOCS
+// de CMake). Reemplaza operator new/delete y cuenta, por hilo y sin locks,
+// asignaciones, bytes pedidos y liberaciones según la etapa en curso del
+// hilo (AllocStage: parseo del JSON, codificación, admisión, impresión...).
+// Cada pedido HTTP suma además lo que asignó su hilo entre que httplib lo
+// entrega y arma la respuesta, por ruta. Todo se ve en /debug/allocs y
+// printagent-loadgen --allocs lo reporta por pedido.
+//
+// Sin la opción AllocStage no hace nada y no se reemplaza operator new.
+//
+// Los contadores viven en ranuras de un arreglo fijo que cada hilo toma en
+// su primera asignación (sin asignar memoria: se llama desde operator new)
+// y devuelve al terminar, sumando lo suyo a los totales de los ya
+// terminados. Los bytes vivos salen del tamaño real del bloque
+// (malloc_usable_size/_msize); donde no se puede saber se informan en 0.
+//
+// Los reemplazos de operator new no pueden ser inline: este header se
+// compila en una sola unidad de traducción (main.cpp), como el resto.
+
+#pragma once
+
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+
+#ifdef HIVA_TRACK_ALLOCS
+#if defined(_WIN32)
+#include <malloc.h>
+#define HIVA_BLOCK_SIZE(p) _msize(p)
+#elif defined(__linux__)
+#include <malloc.h>
+#define HIVA_BLOCK_SIZE(p) malloc_usable_size(p)
+#else
+#define HIVA_BLOCK_SIZE(p) ((size_t)0)
+#endif
+#endif
+
+enum class AllocStageId : uint8_t {
+    Other, Http, Parse, Encode, Admit, Record, Print, Raw, Log, Count
+};
+
+inline const char* allocStageName(AllocStageId s) {
+    static const char* NAMES[] = {"other", "http", "parse", "encode", "admit",
+                                  "record", "print", "raw", "log"};
+    return NAMES[(int)s];
+}
+
+class AllocTracker {
+public:
+    static constexpr int STAGES = (int)AllocStageId::Count;
+
+    struct Counts {
+        uint64_t allocs = 0;
+        uint64_t bytes  = 0;
+    };
+
+#ifdef HIVA_TRACK_ALLOCS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Etapa del hilo actual
+    static AllocStageId stage() { return (AllocStageId)currentStage; }
+    static void setStage(AllocStageId s) {
+        if constexpr (enabled) currentStage = (uint8_t)s;
+    }
+
+    // Lo asignado hasta ahora por este hilo (para restar al cerrar un pedido)
+    static Counts threadCounts() {
+        Counts c;
+        if (Slot* s = localSlot)
+            for (int i = 0; i < STAGES; i++) {
+                c.allocs += s->allocs[i].load(std::memory_order_relaxed);
+                c.bytes  += s->bytes[i].load(std::memory_order_relaxed);
+            }
+        return c;
+    }
+
+    // Pedido HTTP terminado: `before` es threadCounts() al empezarlo
+    static void requestDone(const std::string& method, const std::string& route, const Counts& before) {
+        Counts now = threadCounts();
+        const uint64_t allocs = now.allocs - before.allocs, bytes = now.bytes - before.bytes;
+        AllocTracker& t = instance();
+        std::lock_guard<std::mutex> lock(t.mtx);
+        Route& r = t.routes[method + " " + (route.empty() ? "(sin ruta)" : route)];
+        r.requests++;
+        r.allocs += allocs;
+        r.bytes  += bytes;
+        r.maxAllocs = std::max(r.maxAllocs, allocs);
+    }
+
+    static nlohmann::json snapshot() {
+        using nlohmann::json;
+        json j;
+        j["enabled"] = enabled;
+        if (!enabled) return j;
+
+        AllocTracker& t = instance();
+        uint64_t allocs[STAGES], bytes[STAGES], frees[STAGES];
+        for (int i = 0; i < STAGES; i++) {
+            allocs[i] = t.retired.allocs[i].load(std::memory_order_relaxed);
+            bytes[i]  = t.retired.bytes[i].load(std::memory_order_relaxed);
+            frees[i]  = t.retired.frees[i].load(std::memory_order_relaxed);
+        }
+        for (auto& s : t.slots) {
+            if (!s.used.load(std::memory_order_acquire)) continue;
+            for (int i = 0; i < STAGES; i++) {
+                allocs[i] += s.allocs[i].load(std::memory_order_relaxed);
+                bytes[i]  += s.bytes[i].load(std::memory_order_relaxed);
+                frees[i]  += s.frees[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        json stages = json::object();
+        uint64_t totalAllocs = 0, totalBytes = 0, totalFrees = 0;
+        for (int i = 0; i < STAGES; i++) {
+            stages[allocStageName((AllocStageId)i)] = {{"allocs", allocs[i]}, {"bytes", bytes[i]},
+                                                       {"frees", frees[i]}};
+            totalAllocs += allocs[i];
+            totalBytes  += bytes[i];
+            totalFrees  += frees[i];
+        }
+        j["stages"] = stages;
+        j["total"]  = {{"allocs", totalAllocs}, {"bytes", totalBytes}, {"frees", totalFrees}};
+        j["live_bytes"] = t.liveBytes.load(std::memory_order_relaxed);
+        j["threads_over_capacity"] = t.overflowThreads.load(std::memory_order_relaxed);
+
+        json routes = json::object();
+        std::lock_guard<std::mutex> lock(t.mtx);
+        for (auto& [route, r] : t.routes) {
+            routes[route] = {{"requests", r.requests}, {"allocs", r.allocs}, {"bytes", r.bytes},
+                             {"allocs_per_request", (double)r.allocs / r.requests},
+                             {"bytes_per_request", (double)r.bytes / r.requests},
+                             {"max_allocs", r.maxAllocs}};
+        }
+        j["routes"] = routes;
+        return j;
+    }
+
+    // Desde operator new/delete: no pueden asignar memoria
+    static void onAlloc(void* p, size_t size) {
+        const int stage = currentStage;
+        Slot* s = slot();
+        bump(s->allocs[stage], 1);
+        bump(s->bytes[stage], size);
+#ifdef HIVA_TRACK_ALLOCS
+        instance().liveBytes.fetch_add(HIVA_BLOCK_SIZE(p), std::memory_order_relaxed);
+#else
+        (void)p;
+#endif
+    }
+
+    static void onFree(void* p) {
+        bump(slot()->frees[currentStage], 1);
+#ifdef HIVA_TRACK_ALLOCS
+        instance().liveBytes.fetch_sub(HIVA_BLOCK_SIZE(p), std::memory_order_relaxed);
+#else
+        (void)p;
+#endif
+    }
+
+private:
+    static constexpr size_t SLOTS = 256;
+
+    // Cada ranura la escribe un solo hilo; los atómicos relajados sólo
+    // evitan lecturas rotas desde /debug/allocs
+    struct Slot {
+        std::atomic<uint64_t> allocs[STAGES];
+        std::atomic<uint64_t> bytes[STAGES];
+        std::atomic<uint64_t> frees[STAGES];
+        std::atomic<bool> used;
+    };
+
+    // Devuelve la ranura al terminar el hilo
+    struct Owner {
+        ~Owner() {
+            Slot* s = localSlot;
+            if (!s || s == &instance().overflow) return;
+            localSlot = &instance().overflow;     // lo que se libere desde acá en adelante
+            Slot& r = instance().retired;
+            for (int i = 0; i < STAGES; i++) {
+                r.allocs[i].fetch_add(s->allocs[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+                r.bytes[i].fetch_add(s->bytes[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+                r.frees[i].fetch_add(s->frees[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            s->used.store(false, std::memory_order_release);
+        }
+    };
+
+    Slot slots[SLOTS];
+    Slot overflow;                  // hilos sin ranura libre (compartida: fetch_add)
+    Slot retired;                   // hilos ya terminados
+    std::atomic<uint64_t> liveBytes{0};
+    std::atomic<uint64_t> overflowThreads{0};
+
+    struct Route {
+        uint64_t requests = 0;
+        uint64_t allocs = 0;
+        uint64_t bytes = 0;
+        uint64_t maxAllocs = 0;
+    };
+    std::mutex mtx;
+    std::map<std::string, Route> routes;
+
+    inline static thread_local uint8_t currentStage = 0;
+    inline static thread_local Slot* localSlot = nullptr;
+
+    // Sin pasar por operator new (se llama desde ahí) y sin destructor: los
+    // hilos que terminan después de main siguen liberando memoria
+    static AllocTracker& instance() {
+        alignas(AllocTracker) static unsigned char storage[sizeof(AllocTracker)];
+        static AllocTracker* t = new (storage) AllocTracker();
+        return *t;
+    }
+
+    static Slot* slot() {
+        Slot* s = localSlot;
+        if (s) return s;
+        AllocTracker& t = instance();
+        for (auto& candidate : t.slots) {
+            bool expected = false;
+            if (!candidate.used.load(std::memory_order_relaxed) &&
+                candidate.used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                s = &candidate;
+                break;
+            }
+        }
+        if (!s) {
+            t.overflowThreads.fetch_add(1, std::memory_order_relaxed);
+            s = &t.overflow;
+        }
+        localSlot = s;
+        thread_local Owner owner;
+        (void)owner;
+        return s;
+    }
+
+    // La ranura compartida necesita fetch_add; la propia, no
+    static void bump(std::atomic<uint64_t>& c, uint64_t n) {
+        if (localSlot == &instance().overflow)
+            c.fetch_add(n, std::memory_order_relaxed);
+        else
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// Etapa del hilo mientras vive el objeto; sin HIVA_TRACK_ALLOCS no hace nada
+class AllocStage {
+public:
+    explicit AllocStage(AllocStageId s) : previous(AllocTracker::stage()) { AllocTracker::setStage(s); }
+    ~AllocStage() { AllocTracker::setStage(previous); }
+
+    AllocStage(const AllocStage&) = delete;
+    AllocStage& operator=(const AllocStage&) = delete;
+
+private:
+    AllocStageId previous;
+};
+
+#ifdef HIVA_TRACK_ALLOCS
+
+// Reemplazos globales. Las versiones alineadas quedan con la implementación
+// de la biblioteca (usan su propio asignador y no pasan por acá).
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    AllocTracker::onAlloc(p, size);
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    void* p = std::malloc(size ? size : 1);
+    if (p) AllocTracker::onAlloc(p, size);
+    return p;
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return ::operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    AllocTracker::onFree(p);
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept { ::operator delete(p); }
+void operator delete(void* p, size_t) noexcept { ::operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { ::operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { ::operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { ::operator delete(p); }
+
+#endif
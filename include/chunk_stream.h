@@ -0,0 +1,115 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// ChunkStream - Canal acotado de bloques entre el pedido HTTP y la impresora
+// ============================================================================
+//
+// Lo usa la impresión en streaming: el hilo HTTP codifica mientras recibe
+// el cuerpo y empuja bloques de tamaño fijo; el hilo de la impresora los
+// escribe a medida que llegan. Como el canal tiene profundidad fija, la
+// memoria es constante sin importar el largo del documento: si la
+// impresora va más lenta que la subida, push() bloquea y TCP frena al POS.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class ChunkStream {
+public:
+    using Chunk = std::vector<unsigned char>;
+
+    ChunkStream(size_t chunkSize, size_t depth)
+        : chunkSize(chunkSize), depth(depth) {}
+
+    // Bloquea mientras el canal esté lleno; false si el consumidor abortó
+    bool push(Chunk&& chunk) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this] { return aborted || chunks.size() < depth; });
+        if (aborted) return false;
+        chunks.push_back(std::move(chunk));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Bloquea hasta tener un bloque; false al terminar el documento o si se abortó
+    bool pop(Chunk& out) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this] { return aborted || closed || !chunks.empty(); });
+        if (aborted || chunks.empty()) return false;
+        out = std::move(chunks.front());
+        chunks.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // El productor terminó de enviar el documento
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    // Cancela el documento desde cualquiera de los dos lados
+    void abort() {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    bool isAborted() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return aborted;
+    }
+
+    size_t getChunkSize() const { return chunkSize; }
+
+    // Memoria máxima retenida por el canal (para el control de admisión)
+    size_t capacityBytes() const { return chunkSize * depth; }
+
+private:
+    size_t chunkSize;
+    size_t depth;
+
+    mutable std::mutex mtx;
+    std::condition_variable notEmpty, notFull;
+    std::deque<Chunk> chunks;
+    bool closed  = false;
+    bool aborted = false;
+};
+
+// Acumula bytes codificados y los entrega al canal en bloques de tamaño fijo
+class ChunkWriter {
+public:
+    explicit ChunkWriter(ChunkStream& stream) : stream(stream) {
+        buffer.reserve(stream.getChunkSize());
+    }
+
+    std::vector<unsigned char>& buf() { return buffer; }
+
+    // Llamar después de cada unidad codificada (línea, etiqueta)
+    bool flushFull() {
+        if (buffer.size() < stream.getChunkSize()) return ok;
+        return flush();
+    }
+
+    bool finish() {
+        if (!buffer.empty()) flush();
+        stream.close();
+        return ok;
+    }
+
+private:
+    ChunkStream& stream;
+    std::vector<unsigned char> buffer;
+    bool ok = true;
+
+    bool flush() {
+        ok = ok && stream.push(std::move(buffer));
+        buffer = std::vector<unsigned char>();
+        buffer.reserve(stream.getChunkSize());
+        return ok;
+    }
+};
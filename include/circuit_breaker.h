@@ -0,0 +1,145 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// CircuitBreaker - Corta el tráfico a una impresora que viene fallando
+// ============================================================================
+//
+//   CLOSED    --(tasa de error o timeouts)-->  OPEN
+//   OPEN      --(pasa el cooldown)-->          HALF_OPEN (deja pasar 1 prueba)
+//   HALF_OPEN --(prueba OK)-->                 CLOSED
+//   HALF_OPEN --(prueba falla)-->              OPEN (cooldown x2, hasta 2 min)
+//
+// Mientras está abierto, los trabajos van directo a la impresora de
+// respaldo sin volver a esperar el timeout del equipo caído.
+
+#pragma once
+
+#include "usdt.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Settings {
+        double failureRate   = 0.5;     // proporción de fallas en la ventana
+        size_t window        = 20;      // últimos resultados considerados
+        size_t minSamples    = 5;
+        int    maxConsecutive = 3;      // fallas seguidas que abren de inmediato
+        std::chrono::milliseconds cooldown{10000};
+        std::chrono::milliseconds maxCooldown{120000};
+        std::string name;               // impresora, para la sonda breaker_state
+    };
+
+    CircuitBreaker() = default;
+    explicit CircuitBreaker(const Settings& s) : settings(s), cooldown(s.cooldown) {}
+
+    // ¿Se le puede mandar un trabajo? En HALF_OPEN autoriza una sola prueba.
+    bool allowRequest() {
+        std::lock_guard<std::mutex> lock(mtx);
+        switch (state) {
+            case State::Closed:
+                return true;
+            case State::Open:
+                if (Clock::now() < openUntil) return false;
+                enter(State::HalfOpen);
+                probing = true;
+                return true;
+            case State::HalfOpen:
+                if (probing) return false;
+                probing = true;
+                return true;
+        }
+        return false;
+    }
+
+    // Abierto y todavía dentro del cooldown (no consume la prueba)
+    bool isOpen() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return (state == State::Open && Clock::now() < openUntil) ||
+               (state == State::HalfOpen && probing);
+    }
+
+    void recordSuccess() { record(true); }
+
+    // Una escritura que superó su plazo cuenta como falla aunque haya terminado
+    void recordFailure() { record(false); }
+
+    State getState() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return state;
+    }
+
+    uint64_t getOpenCount() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return opens;
+    }
+
+    static const char* stateName(State s) {
+        switch (s) {
+            case State::Closed: return "closed";
+            case State::Open:   return "open";
+            default:            return "half_open";
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Settings settings;
+    mutable std::mutex mtx;
+    State state = State::Closed;
+    std::deque<bool> outcomes;
+    int consecutive = 0;
+    bool probing = false;
+    std::chrono::milliseconds cooldown{settings.cooldown};
+    Clock::time_point openUntil;
+    uint64_t opens = 0;
+
+    void record(bool ok) {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (state == State::HalfOpen) {
+            probing = false;
+            if (ok) {
+                enter(State::Closed);
+                cooldown = settings.cooldown;
+                outcomes.clear();
+                consecutive = 0;
+            } else {
+                cooldown = std::min(cooldown * 2, settings.maxCooldown);
+                trip();
+            }
+            return;
+        }
+
+        outcomes.push_back(ok);
+        if (outcomes.size() > settings.window) outcomes.pop_front();
+        consecutive = ok ? 0 : consecutive + 1;
+
+        if (state != State::Closed) return;
+
+        size_t failures = std::count(outcomes.begin(), outcomes.end(), false);
+        bool rateTrip = outcomes.size() >= settings.minSamples &&
+                        failures >= settings.failureRate * outcomes.size();
+        if (rateTrip || consecutive >= settings.maxConsecutive) trip();
+    }
+
+    // Con mtx tomado
+    void enter(State s) {
+        state = s;
+        HIVA_PROBE(breaker_state, settings.name.c_str(), stateName(s));
+    }
+
+    // Con mtx tomado
+    void trip() {
+        enter(State::Open);
+        openUntil = Clock::now() + cooldown;
+        opens++;
+        outcomes.clear();
+        consecutive = 0;
+    }
+};
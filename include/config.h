@@ -0,0 +1,236 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Configuración del agente (printagent.json junto al ejecutable)
+// ============================================================================
+//
+// Ejemplo:
+// {
+//   "default_printer": "cocina",
+//   "printers": {
+//     "cocina": { "device": "EPSON TM-T20II", "max_jobs": 32, "raw_port": 9100,
+//                 "coalesce_max_us": 5000 },
+//     "barra":  { "device": "POS-80", "macros": true, "macro_max": 2048,
+//                 "fallback": "cocina", "write_timeout_ms": 10000 },
+//     "prueba": { "backend": "sim", "sim": { "baud": 0, "mm_per_s": 150,
+//                 "cut_ms": 250, "buffer_bytes": 4096, "sink": "127.0.0.1:9300",
+//                 "faults": [ { "kind": "paper_out", "at_doc": 100, "ms": 5000 } ] } }
+//   },
+//   "pools": {
+//     "cocina_pool": { "members": ["cocina", "cocina2"], "raw_port": 9101 },
+//     "barra_pool":  ["barra", "barra2"]
+//   },
+//   "limits": { "max_jobs": 256, "max_bytes": 16777216 },
+//   "scheduled": { "max_jobs": 50000, "max_bytes": 67108864 },
+//   "prepared":  { "max_jobs": 1024, "max_bytes": 33554432, "ttl_ms": 600000 },
+//   "clients":   { "weights": { "caja1": 3, "10.0.0.20": 1 }, "max_share": 0.75 },
+//   "flight_recorder": { "path": "printagent.flight", "max_bytes": 16777216 },
+//   "history": { "path": "printagent.history" },
+//   "log": { "path": "printagent.log", "max_bytes": 8388608, "files": 5, "console": "info" },
+//   "raw_idle_ms": 1000
+// }
+//
+// Sin archivo, se usa una sola impresora lógica "default" que apunta a la
+// primera impresora instalada (comportamiento original).
+
+#pragma once
+
+#include "json.hpp"
+#include "logger.h"
+#include "sim_printer.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Límites de admisión: trabajos y bytes encolados (incluye el que se imprime)
+struct QueueLimits {
+    size_t maxJobs  = 64;
+    size_t maxBytes = 4 * 1024 * 1024;
+};
+
+struct PrinterConfig {
+    std::string device;     // Nombre de la impresora en Windows ("" = primera del backend)
+    QueueLimits limits;
+    bool macros = false;    // Soporta macros GS : / GS ^ para copias
+    size_t macroMax = 2048; // Tamaño del buffer de macro de la impresora
+    int64_t coalesceMaxUs = 5000;   // Ventana máxima para agrupar tickets (0 = no)
+    std::string fallback;           // Impresora de respaldo si ésta falla
+    int writeTimeoutMs = 10000;     // Escritura más lenta que esto cuenta como falla
+    int breakerCooldownMs = 10000;  // Tiempo con el breaker abierto antes de probar
+    double breakerFailureRate = 0.5;
+#ifdef _WIN32
+    std::string backend = "spooler";    // "spooler", "null" o "sim" (printer_backend.h)
+#else
+    std::string backend = "null";
+#endif
+    SimSettings sim;
+};
+
+inline SimSettings parseSim(const nlohmann::json& j) {
+    SimSettings s;
+    s.baud        = j.value("baud", s.baud);
+    s.mmPerSec    = j.value("mm_per_s", s.mmPerSec);
+    s.lineMm      = j.value("line_mm", s.lineMm);
+    s.barcodeMm   = j.value("barcode_mm", s.barcodeMm);
+    s.cutMs       = j.value("cut_ms", s.cutMs);
+    s.bufferBytes = std::max<size_t>(j.value("buffer_bytes", s.bufferBytes), 2);
+    s.sink        = j.value("sink", s.sink);
+    for (auto& f : j.value("faults", nlohmann::json::array())) {
+        SimFault fault;
+        std::string kind = f.value("kind", "");
+        if (!parseSimFault(kind, fault.kind)) {
+            LOG_WARN("sim: falla desconocida {}", kind);
+            continue;
+        }
+        fault.atDoc = f.value("at_doc", fault.atDoc);
+        fault.atMs  = f.value("at_ms", fault.atMs);
+        fault.ms    = f.value("ms", fault.ms);
+        s.faults.push_back(fault);
+    }
+    return s;
+}
+
+// Reparto de cada impresora entre los clientes que la comparten. El cliente
+// es el header X-Client-Id o, sin él, la IP de origen.
+struct ClientPolicy {
+    std::map<std::string, int> weights;     // cliente -> peso (sin entrada = 1)
+    double maxShare = 1.0;                  // parte máxima de la cola por cliente (1 = sin tope)
+
+    int weightOf(const std::string& client) const {
+        auto it = weights.find(client);
+        return it == weights.end() ? 1 : it->second;
+    }
+};
+
+struct AgentConfig {
+    std::string defaultPrinter = "default";
+    std::map<std::string, PrinterConfig> printers;
+    std::map<std::string, std::vector<std::string>> pools;  // pool -> miembros
+    std::map<int, std::string> rawPorts;    // puerto RAW -> impresora o pool
+    QueueLimits globalLimits{256, 16 * 1024 * 1024};
+    QueueLimits scheduledLimits{50000, 64 * 1024 * 1024};  // fire_at / delay_ms pendientes
+    QueueLimits preparedLimits{1024, 32 * 1024 * 1024};    // /jobs/prepare sin confirmar
+    int64_t preparedTtlMs = 10 * 60 * 1000;                // mínimo 1000
+    ClientPolicy clients;
+    std::string flightPath = "printagent.flight";  // últimos trabajos codificados (reimpresión)
+    size_t flightBytes = 16 * 1024 * 1024;         // 0 = sin historial
+    std::string historyPath = "printagent.history"; // todo lo impreso, indexado ("" = no)
+    LogSettings log;
+    int rawIdleMs = 1000;   // Inactividad que cierra un trabajo RAW
+};
+
+inline QueueLimits parseLimits(const nlohmann::json& j, QueueLimits base) {
+    base.maxJobs  = j.value("max_jobs",  base.maxJobs);
+    base.maxBytes = j.value("max_bytes", base.maxBytes);
+    return base;
+}
+
+inline AgentConfig loadConfig(const std::string& path) {
+    AgentConfig cfg;
+
+    std::ifstream in(path);
+    if (in) {
+        try {
+            auto j = nlohmann::json::parse(in);
+
+            if (j.contains("limits"))
+                cfg.globalLimits = parseLimits(j["limits"], cfg.globalLimits);
+            if (j.contains("scheduled"))
+                cfg.scheduledLimits = parseLimits(j["scheduled"], cfg.scheduledLimits);
+            if (j.contains("prepared")) {
+                cfg.preparedLimits = parseLimits(j["prepared"], cfg.preparedLimits);
+                cfg.preparedTtlMs  = std::max<int64_t>(j["prepared"].value("ttl_ms", cfg.preparedTtlMs), 1000);
+            }
+
+            if (j.contains("clients")) {
+                auto& c = j["clients"];
+                auto weights = c.value("weights", nlohmann::json::object());
+                for (auto& [client, w] : weights.items())
+                    cfg.clients.weights[client] = std::max(w.get<int>(), 1);
+                cfg.clients.maxShare = std::clamp(c.value("max_share", cfg.clients.maxShare), 0.01, 1.0);
+            }
+
+            if (j.contains("flight_recorder")) {
+                cfg.flightPath  = j["flight_recorder"].value("path", cfg.flightPath);
+                cfg.flightBytes = j["flight_recorder"].value("max_bytes", cfg.flightBytes);
+            }
+
+            if (j.contains("history"))
+                cfg.historyPath = j["history"].value("path", cfg.historyPath);
+
+            if (j.contains("log")) {
+                auto& l = j["log"];
+                cfg.log.path     = l.value("path", cfg.log.path);
+                cfg.log.maxBytes = l.value("max_bytes", cfg.log.maxBytes);
+                cfg.log.files    = l.value("files", cfg.log.files);
+                std::string console = l.value("console", "info");
+                if (!parseLogLevel(console, cfg.log.console))
+                    LOG_WARN("log.console invalido: {}", console);
+            }
+
+            if (j.contains("printers")) {
+                for (auto& [name, p] : j["printers"].items()) {
+                    PrinterConfig pc;
+                    pc.device = p.value("device", "");
+                    pc.limits = parseLimits(p, pc.limits);
+                    if (p.value("raw_port", 0) > 0)
+                        cfg.rawPorts[p["raw_port"].get<int>()] = name;
+                    pc.macros = p.value("macros", false);
+                    pc.macroMax = p.value("macro_max", pc.macroMax);
+                    pc.coalesceMaxUs = p.value("coalesce_max_us", pc.coalesceMaxUs);
+                    pc.fallback = p.value("fallback", "");
+                    pc.writeTimeoutMs = p.value("write_timeout_ms", pc.writeTimeoutMs);
+                    pc.breakerCooldownMs = p.value("breaker_cooldown_ms", pc.breakerCooldownMs);
+                    pc.breakerFailureRate = p.value("breaker_failure_rate", pc.breakerFailureRate);
+                    pc.backend = p.value("backend", pc.backend);
+                    if (p.contains("sim")) pc.sim = parseSim(p["sim"]);
+                    cfg.printers[name] = pc;
+                }
+            }
+
+            if (j.contains("pools")) {
+                for (auto& [name, p] : j["pools"].items()) {
+                    auto members = p.is_array() ? p : p.value("members", nlohmann::json::array());
+                    if (p.is_object() && p.value("raw_port", 0) > 0)
+                        cfg.rawPorts[p["raw_port"].get<int>()] = name;
+
+                    std::vector<std::string> valid;
+                    for (auto& m : members.get<std::vector<std::string>>()) {
+                        if (cfg.printers.count(m)) valid.push_back(m);
+                        else LOG_WARN("Pool {}: impresora desconocida {}", name, m);
+                    }
+                    if (cfg.printers.count(name))
+                        LOG_WARN("Pool {} tapa a una impresora con el mismo nombre", name);
+                    if (!valid.empty()) cfg.pools[name] = valid;
+                }
+            }
+
+            cfg.rawIdleMs = j.value("raw_idle_ms", cfg.rawIdleMs);
+
+            cfg.defaultPrinter = j.value("default_printer",
+                cfg.printers.empty() ? cfg.defaultPrinter : cfg.printers.begin()->first);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Error en {}: {}", path, e.what());
+            cfg = AgentConfig();
+        }
+    }
+
+    if (cfg.printers.empty())
+        cfg.printers[cfg.defaultPrinter] = PrinterConfig();
+
+    for (auto& [name, pc] : cfg.printers) {
+        if (pc.fallback.empty()) continue;
+        if (pc.fallback == name || !cfg.printers.count(pc.fallback)) {
+            LOG_WARN("Respaldo invalido para {}: {}", name, pc.fallback);
+            pc.fallback.clear();
+        }
+    }
+
+    if (!cfg.printers.count(cfg.defaultPrinter) && !cfg.pools.count(cfg.defaultPrinter)) {
+        LOG_WARN("default_printer desconocida: {}", cfg.defaultPrinter);
+        cfg.defaultPrinter = cfg.printers.begin()->first;
+    }
+
+    return cfg;
+}
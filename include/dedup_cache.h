@@ -0,0 +1,170 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// DedupCache - Cache de idempotencia sin locks para reintentos del POS
+// ============================================================================
+//
+// Tabla hash concurrente dividida en shards, con direccionamiento abierto
+// (sondeo lineal acotado) y expiración por TTL. Cada slot es un trío de
+// atómicos; no hay mutex en el camino de la petición.
+//
+// Ciclo de vida de un slot:
+//   EMPTY --CAS--> BUSY --store--> <clave> (PENDING) --complete--> <clave> (DONE)
+//                                            \--release--> EMPTY
+// Un slot vencido (expires <= ahora) se puede reciclar con el mismo CAS.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+class DedupCache {
+public:
+    // Resultado original de un trabajo, devuelto tal cual a los duplicados
+    struct Result {
+        bool     success = false;
+        uint64_t jobId   = 0;
+    };
+
+    // Reserva obtenida por el primer pedido con una clave dada
+    struct Ticket {
+        void*    slot = nullptr;
+        uint64_t key  = 0;
+    };
+
+    enum class Claim { Owner, Duplicate, Full };
+
+    explicit DedupCache(size_t shards = 16, size_t slotsPerShard = 1024,
+                        std::chrono::milliseconds ttl = std::chrono::minutes(10))
+        : shardMask(roundPow2(shards) - 1),
+          slotMask(roundPow2(slotsPerShard) - 1),
+          ttlMs(ttl.count()),
+          slots(new Slot[(shardMask + 1) * (slotMask + 1)]) {}
+
+    // Owner: el llamador debe ejecutar el trabajo y luego complete() o release().
+    // Duplicate: `out` tiene el resultado original (espera si sigue en curso).
+    // Full: no hay lugar en la ventana de sondeo; se procesa sin deduplicar.
+    Claim acquire(const std::string& rawKey, Ticket& ticket, Result& out) {
+        const uint64_t h = hashKey(rawKey);
+        Slot* base = slots.get() + ((h >> 48) & shardMask) * (slotMask + 1);
+        const size_t start = h & slotMask;
+
+        for (;;) {
+            const int64_t now = nowMs();
+            Slot* reclaim = nullptr;
+            bool busy = false, pending = false;
+
+            for (size_t i = 0; i < PROBE_WINDOW; i++) {
+                Slot& s = base[(start + i) & slotMask];
+                uint64_t k = s.key.load(std::memory_order_acquire);
+
+                if (k == h) {
+                    uint64_t st  = s.state.load(std::memory_order_acquire);
+                    int64_t  exp = s.expires.load(std::memory_order_acquire);
+                    if (s.key.load(std::memory_order_acquire) != h) { busy = true; continue; }
+                    if (exp <= now) { if (!reclaim) reclaim = &s; continue; }
+                    if (st & DONE) { out = unpack(st); return Claim::Duplicate; }
+                    pending = true;
+                    break;
+                }
+                if (k == BUSY) { busy = true; continue; }
+                if (!reclaim && (k == EMPTY || s.expires.load(std::memory_order_acquire) <= now))
+                    reclaim = &s;
+            }
+
+            if (pending) {
+                // El pedido original sigue imprimiendo: esperar su resultado
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            if (busy) { std::this_thread::yield(); continue; }
+            if (!reclaim) return Claim::Full;
+
+            uint64_t expected = reclaim->key.load(std::memory_order_acquire);
+            bool free = expected == EMPTY ||
+                        (expected != BUSY && reclaim->expires.load(std::memory_order_acquire) <= now);
+            if (!free || !reclaim->key.compare_exchange_strong(expected, BUSY,
+                                                               std::memory_order_acq_rel))
+                continue;
+
+            reclaim->state.store(PENDING, std::memory_order_relaxed);
+            reclaim->expires.store(now + ttlMs, std::memory_order_relaxed);
+            reclaim->key.store(h, std::memory_order_release);
+
+            ticket.slot = reclaim;
+            ticket.key  = h;
+            return Claim::Owner;
+        }
+    }
+
+    // Publica el resultado para los reintentos que lleguen durante el TTL
+    void complete(const Ticket& ticket, const Result& r) {
+        Slot* s = static_cast<Slot*>(ticket.slot);
+        if (!s || s->key.load(std::memory_order_acquire) != ticket.key) return;
+        s->expires.store(nowMs() + ttlMs, std::memory_order_relaxed);
+        s->state.store(pack(r), std::memory_order_release);
+    }
+
+    // Libera la clave sin resultado (error): el próximo reintento vuelve a ejecutar
+    void release(const Ticket& ticket) {
+        Slot* s = static_cast<Slot*>(ticket.slot);
+        if (!s) return;
+        uint64_t expected = ticket.key;
+        s->key.compare_exchange_strong(expected, EMPTY, std::memory_order_acq_rel);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key{EMPTY};
+        std::atomic<int64_t>  expires{0};
+        std::atomic<uint64_t> state{PENDING};
+    };
+
+    static constexpr uint64_t EMPTY   = 0;
+    static constexpr uint64_t BUSY    = 1;
+    static constexpr uint64_t PENDING = 0;
+    static constexpr uint64_t DONE    = 1ull << 63;
+    static constexpr uint64_t SUCCESS = 1ull << 62;
+    static constexpr uint64_t JOB_MASK = SUCCESS - 1;
+    static constexpr size_t   PROBE_WINDOW = 16;
+
+    size_t  shardMask;
+    size_t  slotMask;
+    int64_t ttlMs;
+    std::unique_ptr<Slot[]> slots;
+
+    static size_t roundPow2(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    // FNV-1a de 64 bits; 0 y 1 quedan reservados para EMPTY y BUSY
+    static uint64_t hashKey(const std::string& s) {
+        uint64_t h = 1469598103934665603ull;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h < 2 ? h + 2 : h;
+    }
+
+    static uint64_t pack(const Result& r) {
+        return DONE | (r.success ? SUCCESS : 0) | (r.jobId & JOB_MASK);
+    }
+
+    static Result unpack(uint64_t st) {
+        Result r;
+        r.success = (st & SUCCESS) != 0;
+        r.jobId   = st & JOB_MASK;
+        return r;
+    }
+
+    static int64_t nowMs() {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+};
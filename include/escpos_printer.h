@@ -0,0 +1,263 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// ESCPOSPrinter - Manejo de impresoras térmicas ESC/POS
+// ============================================================================
+
+#pragma once
+
+#include "logger.h"
+#include "printer_backend.h"
+#include "spooler_backend.h"
+#include "tracer.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+typedef unsigned char BYTE;
+#endif
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include <string>
+
+// Recibe aviso antes y después de cada llamada al backend que se puede
+// colgar (USB trabado, conexión de red a medias); la cola pone ahí el plazo.
+// progress() llega durante una escritura larga cada vez que el equipo acepta
+// bytes.
+class WriteWatch {
+public:
+    virtual ~WriteWatch() = default;
+    virtual void armed() = 0;
+    virtual void progress() {}
+    virtual void disarmed() = 0;
+};
+
+class ESCPOSPrinter {
+private:
+    std::unique_ptr<PrinterBackend> backend;
+    std::string printerName;
+    bool isOpen;
+    std::atomic<bool> aborted{false};
+    WriteWatch* watch = nullptr;
+
+    struct Watched {
+        WriteWatch* w;
+        explicit Watched(WriteWatch* w) : w(w) { if (w) w->armed(); }
+        ~Watched() { if (w) w->disarmed(); }
+    };
+
+    inline static const std::vector<BYTE> ESC_INIT        = {0x1B, 0x40};
+    inline static const std::vector<BYTE> ESC_ALIGN_LEFT  = {0x1B, 0x61, 0x00};
+    inline static const std::vector<BYTE> ESC_ALIGN_CENTER= {0x1B, 0x61, 0x01};
+    inline static const std::vector<BYTE> ESC_FEED        = {0x0A};
+    inline static const std::vector<BYTE> ESC_CUT         = {0x1D, 0x56, 0x00};
+
+public:
+    explicit ESCPOSPrinter(std::unique_ptr<PrinterBackend> backend)
+        : backend(std::move(backend)), isOpen(false) {}
+    ~ESCPOSPrinter() { close(); }
+
+    ESCPOSPrinter(const ESCPOSPrinter&) = delete;
+    ESCPOSPrinter& operator=(const ESCPOSPrinter&) = delete;
+
+    void setWatch(WriteWatch* w) {
+        watch = w;
+        backend->setProgress([w] { if (w) w->progress(); });
+    }
+
+    // Impresoras instaladas en Windows (vacío en otros sistemas)
+    static std::vector<std::string> listPrinters() {
+#ifdef _WIN32
+        return SpoolerBackend::listPrinters();
+#else
+        return {};
+#endif
+    }
+
+    bool open(const std::string& name = "") {
+        if (isOpen) return true;
+
+        printerName = name.empty() ? backend->defaultDevice() : name;
+        if (printerName.empty()) {
+            LOG_ERROR("No se encontraron impresoras instaladas");
+            return false;
+        }
+
+        Watched guard(watch);
+        TraceSpan span("spooler", "OpenPrinter");
+        if (!backend->open(printerName)) {
+            LOG_ERROR("Error al abrir impresora {}. Codigo: {}", printerName, backend->lastError());
+            return false;
+        }
+
+        isOpen = true;
+        return true;
+    }
+
+    void close() {
+        if (isOpen) {
+            backend->close();
+            isOpen = false;
+        }
+    }
+
+    // Desde otro hilo, con una llamada colgada: el backend cancela el
+    // documento y hace volver la llamada (en Windows, cancelando el trabajo
+    // en el spooler). El handle lo cierra después el hilo dueño.
+    // Después de esto la instancia sólo falla; hay que usar otra.
+    void abort() {
+        if (aborted.exchange(true)) return;
+        backend->abort();
+    }
+
+    // Abre un documento RAW; los bytes se mandan con write() hasta endDoc()
+    bool beginDoc() {
+        if (!isOpen || aborted) return false;
+        Watched guard(watch);
+        TraceSpan span("spooler", "StartDocPrinter");
+        return backend->beginDoc();
+    }
+
+    bool write(const BYTE* data, size_t size) {
+        if (aborted) return false;
+        Watched guard(watch);
+        TraceSpan span("spooler", "WritePrinter");
+        return backend->write(data, size);
+    }
+
+    // Escribe el mismo buffer `times` veces sin replicarlo en memoria: las
+    // copias chicas se agrupan en un buffer de paso de tamaño fijo para no
+    // hacer una llamada a WritePrinter por copia
+    bool writeRepeated(const BYTE* data, size_t size, int times) {
+        const size_t STAGING = 64 * 1024;
+        int perWrite = (int)std::max<size_t>(1, std::min<size_t>(times, STAGING / std::max<size_t>(size, 1)));
+
+        if (perWrite == 1) {
+            for (int i = 0; i < times; i++)
+                if (!write(data, size)) return false;
+            return true;
+        }
+
+        std::vector<BYTE> staging;
+        staging.reserve(size * perWrite);
+        for (int i = 0; i < perWrite; i++)
+            staging.insert(staging.end(), data, data + size);
+
+        for (int left = times; left > 0; left -= perWrite) {
+            int n = std::min(left, perWrite);
+            if (!write(staging.data(), size * n)) return false;
+        }
+        return true;
+    }
+
+    void endDoc() {
+        if (aborted) return;
+        Watched guard(watch);
+        TraceSpan span("spooler", "EndDocPrinter");
+        backend->endDoc();
+    }
+
+    bool sendRaw(const std::vector<BYTE>& data) {
+        if (!beginDoc()) return false;
+        bool ok = write(data.data(), data.size());
+        endDoc();
+        return ok;
+    }
+
+    // Piezas de codificación, usadas también por la impresión en streaming
+    static void beginTicket(std::vector<BYTE>& data) {
+        data.insert(data.end(), ESC_INIT.begin(), ESC_INIT.end());
+        data.insert(data.end(), ESC_ALIGN_LEFT.begin(), ESC_ALIGN_LEFT.end());
+    }
+
+    static void beginLabels(std::vector<BYTE>& data) {
+        data.insert(data.end(), ESC_INIT.begin(), ESC_INIT.end());
+        data.insert(data.end(), ESC_ALIGN_CENTER.begin(), ESC_ALIGN_CENTER.end());
+    }
+
+    static void appendLine(std::vector<BYTE>& data, const std::string& line) {
+        data.insert(data.end(), line.begin(), line.end());
+        data.insert(data.end(), ESC_FEED.begin(), ESC_FEED.end());
+    }
+
+    static void appendBarcode(std::vector<BYTE>& data, const std::string& code) {
+        static const BYTE CODE128[] = {0x1D, 0x6B, 0x43, 0x0C};
+        data.insert(data.end(), std::begin(CODE128), std::end(CODE128));
+        data.insert(data.end(), code.begin(), code.end());
+        data.insert(data.end(), ESC_FEED.begin(), ESC_FEED.end());
+    }
+
+    static void appendCut(std::vector<BYTE>& data) {
+        data.insert(data.end(), ESC_CUT.begin(), ESC_CUT.end());
+    }
+
+    // Codifica un ticket de texto (sin enviarlo)
+    static std::vector<BYTE> encodeTicket(const std::vector<std::string>& lines) {
+        std::vector<BYTE> data;
+        beginTicket(data);
+
+        for (auto& line : lines)
+            appendLine(data, line);
+
+        appendCut(data);
+        return data;
+    }
+
+    // Codifica una copia de etiquetas CODE128 con texto opcional, sin
+    // encabezado ni corte: las copias repiten este mismo buffer
+    static std::vector<BYTE> encodeLabelSet(const std::vector<std::string>& codes,
+                                            const std::string& text)
+    {
+        std::vector<BYTE> data;
+        if (!text.empty())
+            appendLine(data, text);
+
+        for (auto& code : codes)
+            appendBarcode(data, code);
+
+        return data;
+    }
+
+    // Define `size` bytes como macro (GS :) y la ejecuta `times` veces (GS ^)
+    static void appendMacro(std::vector<BYTE>& data, const BYTE* body, size_t size, int times) {
+        static const BYTE MACRO_DEF[] = {0x1D, 0x3A};
+        data.insert(data.end(), std::begin(MACRO_DEF), std::end(MACRO_DEF));
+        data.insert(data.end(), body, body + size);
+        data.insert(data.end(), std::begin(MACRO_DEF), std::end(MACRO_DEF));
+
+        while (times > 0) {
+            BYTE r = (BYTE)std::min(times, 255);
+            BYTE exec[] = {0x1D, 0x5E, r, 0x00, 0x00};
+            data.insert(data.end(), std::begin(exec), std::end(exec));
+            times -= r;
+        }
+    }
+
+    // Texto imprimible de un flujo ESC/POS (saca los comandos y sus
+    // parámetros). Para indexar el historial; no es un decodificador completo.
+    static std::string plainText(const BYTE* d, size_t n) {
+        std::string out;
+        for (size_t i = 0; i < n; i++) {
+            BYTE c = d[i];
+            if (c == 0x1B && i + 1 < n) {
+                BYTE cmd = d[++i];
+                if (cmd != 0x40) i++;                           // ESC @ no lleva parámetro
+            } else if (c == 0x1D && i + 1 < n) {
+                BYTE cmd = d[++i];
+                if (cmd == 0x56)      i += (i + 1 < n && d[i + 1] >= 65) ? 2 : 1;   // GS V m [n]
+                else if (cmd == 0x6B) i += 2;                   // GS k m n: los datos son texto
+                else if (cmd == 0x5E) i += 3;                   // GS ^ r t m
+                else if (cmd != 0x3A) i++;                      // GS : sin parámetro
+            } else if (c == '\n') {
+                out += '\n';
+            } else if (c >= 0x20) {
+                out += (char)c;
+            }
+        }
+        return out;
+    }
+
+    bool getIsOpen() const { return isOpen; }
+    std::string getPrinterName() const { return printerName; }
+};
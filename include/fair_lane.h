@@ -0,0 +1,149 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// FairLane - Carril de prioridad con reparto justo entre clientes (DRR)
+// ============================================================================
+//
+// Cada cliente (terminal o IP) tiene su propia fila dentro del carril y las
+// filas se atienden por turnos con Deficit Round Robin: en su turno, una
+// fila suma `QUANTUM_BYTES * peso` de crédito y saca trabajos mientras le
+// alcance; el crédito sobrante se guarda para el próximo turno y se pierde
+// si la fila se vacía. Así un cliente que inunda la impresora con etiquetas
+// no posterga a los demás más que su parte.
+//
+// Un trabajo cuesta sus bytes más un fijo por el corte y avance de papel:
+// diez tickets de una línea no valen lo mismo que uno de diez líneas.
+// Las vueltas en que nadie junta crédito para su próximo trabajo (un
+// masivo grande) se saltean de una vez, así sacar, mirar el próximo y
+// quitar por id son O(clientes activos) en el peor caso.
+// No es thread-safe: lo protege el mutex de la cola.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+template <typename JobPtr>
+class FairLane {
+public:
+    static constexpr int64_t QUANTUM_BYTES = 1024;
+    static constexpr int64_t JOB_COST_BYTES = 512;
+
+    // `front`: primero de su fila y su fila primera en la ronda (reencolados
+    // por el watchdog y "pasar al frente")
+    void push(const JobPtr& job, int weight, bool front) {
+        Flow& f = flows[job->client];
+        if (f.jobs.empty()) {
+            f.client = job->client;
+            f.weight = std::max(weight, 1);
+            f.ringPos = front ? ring.insert(ring.begin(), &f) : ring.insert(ring.end(), &f);
+        } else if (front) {
+            ring.splice(ring.begin(), ring, f.ringPos);
+        }
+
+        auto pos = front ? f.jobs.insert(f.jobs.begin(), job) : f.jobs.insert(f.jobs.end(), job);
+        index[job->id] = {&f, pos};
+        count++;
+
+        if (front) {
+            f.deficit = std::max<int64_t>(f.deficit, cost(*job));
+            f.inTurn = true;
+        }
+    }
+
+    // El que saldría ahora (avanza la ronda hasta que alguien tenga crédito)
+    JobPtr peek() {
+        Flow* f = select();
+        return f ? f->jobs.front() : nullptr;
+    }
+
+    JobPtr pop() {
+        Flow* f = select();
+        if (!f) return nullptr;
+        JobPtr job = f->jobs.front();
+        f->deficit -= cost(*job);
+        unlink(f, f->jobs.begin());
+        return job;
+    }
+
+    // Quita un trabajo por id; nullptr si no está en este carril
+    JobPtr remove(uint64_t id) {
+        auto it = index.find(id);
+        if (it == index.end()) return nullptr;
+        JobPtr job = *it->second.pos;
+        unlink(it->second.flow, it->second.pos);
+        return job;
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+private:
+    struct Flow {
+        std::string client;
+        std::list<JobPtr> jobs;
+        int weight = 1;
+        int64_t deficit = 0;
+        bool inTurn = false;                    // ya sumó el crédito de este turno
+        typename std::list<Flow*>::iterator ringPos;
+    };
+
+    struct Entry {
+        Flow* flow;
+        typename std::list<JobPtr>::iterator pos;
+    };
+
+    std::unordered_map<std::string, Flow> flows;    // sólo filas con trabajos
+    std::list<Flow*> ring;                          // ronda de filas activas
+    std::unordered_map<uint64_t, Entry> index;
+    size_t count = 0;
+
+    static int64_t cost(const typename JobPtr::element_type& job) {
+        return (int64_t)job.queuedSize() + JOB_COST_BYTES;
+    }
+
+    static int64_t quantum(const Flow& f) { return QUANTUM_BYTES * f.weight; }
+
+    Flow* select() {
+        for (size_t misses = 0; !ring.empty();) {
+            Flow* f = ring.front();
+            if (!f->inTurn) {
+                f->deficit += quantum(*f);
+                f->inTurn = true;
+            }
+            if (f->deficit >= cost(*f->jobs.front())) return f;
+
+            // No le alcanza: guarda el crédito y pasa al siguiente
+            f->inTurn = false;
+            ring.splice(ring.end(), ring, ring.begin());
+            if (++misses == ring.size()) {
+                skipEmptyRounds();
+                misses = 0;
+            }
+        }
+        return nullptr;
+    }
+
+    // Nadie alcanzó en una vuelta entera: suma de una vez el crédito de las
+    // vueltas que pasarían en vano hasta que el primero alcance
+    void skipEmptyRounds() {
+        int64_t rounds = INT64_MAX;
+        for (Flow* f : ring)
+            rounds = std::min(rounds, (cost(*f->jobs.front()) - f->deficit - 1) / quantum(*f));
+        if (rounds <= 0) return;
+        for (Flow* f : ring) f->deficit += rounds * quantum(*f);
+    }
+
+    void unlink(Flow* f, typename std::list<JobPtr>::iterator pos) {
+        index.erase((*pos)->id);
+        f->jobs.erase(pos);
+        count--;
+        if (f->jobs.empty()) {
+            ring.erase(f->ringPos);
+            flows.erase(f->client);
+        }
+    }
+};
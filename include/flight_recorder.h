@@ -0,0 +1,372 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// FlightRecorder - Últimos trabajos codificados, para reimprimir al instante
+// ============================================================================
+//
+// Cada trabajo aceptado por una cola se copia, ya codificado, a un anillo de
+// bytes de tamaño fijo mapeado a un archivo (printagent.flight): reimprimir
+// una comanda perdida es volver a mandar esos bytes, sin que el POS rearme
+// el pedido ni el agente vuelva a codificar nada. Al estar mapeado, lo
+// grabado sobrevive a una caída del proceso y se reindexa al arrancar.
+//
+// Se guardan los tramos tal cual (bytes + repeticiones): 1000 copias de una
+// etiqueta ocupan lo que una. Impresora, cliente y ticket_id van completos,
+// con su largo: un nombre recortado no encontraría la impresora al
+// reimprimir. Lo más viejo se pisa al dar la vuelta. Los streamings no se
+// graban (sus bytes no se retienen).
+//
+// Si no se puede mapear el archivo, el anillo queda sólo en memoria.
+
+#pragma once
+
+#include "print_queue.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+class FlightRecorder {
+public:
+    struct Meta {
+        uint64_t jobId = 0;
+        int64_t  time  = 0;         // epoch ms
+        std::string printer;
+        std::string source;         // cliente (X-Client-Id o IP)
+        std::string ticket;         // ticket_id del POS, si lo mandó
+        size_t   bytes = 0;         // bytes a imprimir (con repeticiones)
+    };
+
+    struct Record {
+        Meta meta;
+        std::vector<Segment> segments;
+    };
+
+    FlightRecorder() = default;
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+    ~FlightRecorder() { unmap(); }
+
+    // `capacity` = bytes del anillo (0 = deshabilitado)
+    void open(const std::string& path, size_t capacity) {
+        std::lock_guard<std::mutex> lock(mtx);
+        capacity = capacity / 8 * 8;
+        if (capacity < MIN_CAPACITY) return;
+
+        const size_t total = sizeof(FileHeader) + capacity;
+        if (!map(path, total)) {
+            LOG_WARN("No se pudo mapear {}; historial de reimpresion en memoria", path);
+            heap.assign(total, 0);
+            base = heap.data();
+        }
+
+        header = reinterpret_cast<FileHeader*>(base);
+        data   = base + sizeof(FileHeader);
+
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->capacity == capacity &&
+            reindex())
+        {
+            LOG_INFO("Historial de reimpresion: {} trabajos", order.size());
+            return;
+        }
+
+        std::memset(header, 0, sizeof(FileHeader));
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->capacity = capacity;
+        order.clear();
+        byId.clear();
+    }
+
+    bool enabled() const { return header != nullptr; }
+
+    // Graba un trabajo aceptado por `printer`
+    void record(const PrintJob& job, const std::string& printer) {
+        if (!header || job.stream) return;
+
+        const uint16_t printerLen = textLength(printer), sourceLen = textLength(job.client),
+                       ticketLen  = textLength(job.ticket);
+        size_t payload = (size_t)printerLen + sourceLen + ticketLen;
+        for (auto& seg : job.segments) payload += sizeof(SegmentHeader) + seg.bytes->size();
+        const size_t length = align(sizeof(RecordHeader) + payload);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        const uint64_t capacity = header->capacity;
+        if (length > capacity / 4) return;      // pisaría demasiado historial
+
+        uint64_t at = header->head;
+        if (at + length > capacity) {
+            // No entra al final: se marca la vuelta y se sigue desde el principio
+            evict(at, capacity);
+            if (capacity - at >= sizeof(uint32_t)) std::memcpy(data + at, &WRAP, sizeof(WRAP));
+            at = 0;
+        }
+        evict(at, at + length);
+
+        RecordHeader rh{};
+        rh.magic    = RECORD;
+        rh.length   = (uint32_t)length;
+        rh.jobId    = job.id;
+        rh.time     = JobTracker::epochMs();
+        rh.segments = (uint32_t)job.segments.size();
+        rh.printerLen = printerLen;
+        rh.sourceLen  = sourceLen;
+        rh.ticketLen  = ticketLen;
+
+        uint8_t* p = data + at + sizeof(RecordHeader);
+        std::memcpy(p, printer.data(), printerLen);
+        p += printerLen;
+        std::memcpy(p, job.client.data(), sourceLen);
+        p += sourceLen;
+        std::memcpy(p, job.ticket.data(), ticketLen);
+        p += ticketLen;
+        for (auto& seg : job.segments) {
+            SegmentHeader sh{(uint32_t)seg.repeat, (uint32_t)seg.bytes->size()};
+            std::memcpy(p, &sh, sizeof(sh));
+            std::memcpy(p + sizeof(sh), seg.bytes->data(), seg.bytes->size());
+            p += sizeof(sh) + seg.bytes->size();
+        }
+        std::memcpy(data + at, &rh, sizeof(rh));
+
+        order.push_back({at, job.id});
+        byId[job.id] = at;
+        header->head  = at + length;
+        header->tail  = order.front().offset;
+        header->count = order.size();
+    }
+
+    bool find(uint64_t id, Record& out) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = byId.find(id);
+        if (it == byId.end()) return false;
+
+        const RecordHeader& rh = recordAt(it->second);
+        out.meta = metaOf(rh);
+        out.segments.clear();
+
+        const uint8_t* p = segmentsOf(rh);
+        for (uint32_t i = 0; i < rh.segments; i++) {
+            SegmentHeader sh;
+            std::memcpy(&sh, p, sizeof(sh));
+            p += sizeof(sh);
+            out.segments.push_back({std::make_shared<const std::vector<BYTE>>(p, p + sh.length),
+                                    (int)sh.repeat});
+            p += sh.length;
+        }
+        return true;
+    }
+
+    // Los más recientes primero
+    std::vector<Meta> recent(size_t limit, const std::string& ticket = "") const {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<Meta> out;
+        for (auto it = order.rbegin(); it != order.rend() && out.size() < limit; ++it) {
+            Meta m = metaOf(recordAt(it->offset));
+            if (ticket.empty() || m.ticket == ticket) out.push_back(std::move(m));
+        }
+        return out;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return order.size();
+    }
+
+    size_t capacityBytes() const { return header ? header->capacity : 0; }
+
+    // Mayor id grabado: los ids nuevos siguen desde acá para no repetir los
+    // de una ejecución anterior
+    uint64_t lastJobId() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        uint64_t last = 0;
+        for (auto& e : order) last = std::max(last, e.jobId);
+        return last;
+    }
+
+private:
+    static constexpr char     MAGIC[8] = {'H', 'I', 'V', 'A', 'F', 'R', '2', 0};
+    static constexpr uint32_t RECORD = 0x52435246;      // "FRCR"
+    static constexpr uint32_t WRAP   = 0x50415257;      // "WRAP": sigue en el offset 0
+    static constexpr size_t   MIN_CAPACITY = 64 * 1024;
+
+    struct FileHeader {
+        char     magic[8];
+        uint64_t capacity;
+        uint64_t head;          // próximo offset de escritura
+        uint64_t tail;          // registro más viejo
+        uint64_t count;
+    };
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t length;        // con encabezado y relleno a 8
+        uint64_t jobId;
+        int64_t  time;
+        uint32_t segments;
+        uint16_t printerLen;    // los textos siguen al encabezado, sin NUL,
+        uint16_t sourceLen;     // en este orden y antes de los tramos
+        uint16_t ticketLen;
+        uint16_t reserved;
+        uint32_t reserved2;
+    };
+
+    struct SegmentHeader {
+        uint32_t repeat;
+        uint32_t length;
+    };
+
+    struct Entry {
+        uint64_t offset;
+        uint64_t jobId;
+    };
+
+    mutable std::mutex mtx;
+    uint8_t* base = nullptr;
+    FileHeader* header = nullptr;
+    uint8_t* data = nullptr;
+    std::vector<uint8_t> heap;      // sin archivo
+    std::deque<Entry> order;        // del más viejo al más nuevo
+    std::unordered_map<uint64_t, uint64_t> byId;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    size_t mappedBytes = 0;
+
+    static size_t align(size_t n) { return (n + 7) & ~(size_t)7; }
+
+    // Un texto se graba entero; sólo lo absurdo (> 64 KB) se recorta
+    static uint16_t textLength(const std::string& s) {
+        return (uint16_t)std::min<size_t>(s.size(), UINT16_MAX);
+    }
+
+    static const uint8_t* textsOf(const RecordHeader& rh) {
+        return reinterpret_cast<const uint8_t*>(&rh) + sizeof(RecordHeader);
+    }
+
+    static const uint8_t* segmentsOf(const RecordHeader& rh) {
+        return textsOf(rh) + rh.printerLen + rh.sourceLen + rh.ticketLen;
+    }
+
+    const RecordHeader& recordAt(uint64_t offset) const {
+        return *reinterpret_cast<const RecordHeader*>(data + offset);
+    }
+
+    Meta metaOf(const RecordHeader& rh) const {
+        Meta m;
+        m.jobId   = rh.jobId;
+        m.time    = rh.time;
+        const char* t = reinterpret_cast<const char*>(textsOf(rh));
+        m.printer.assign(t, rh.printerLen);
+        m.source.assign(t + rh.printerLen, rh.sourceLen);
+        m.ticket.assign(t + rh.printerLen + rh.sourceLen, rh.ticketLen);
+        const uint8_t* p = segmentsOf(rh);
+        for (uint32_t i = 0; i < rh.segments; i++) {
+            SegmentHeader sh;
+            std::memcpy(&sh, p, sizeof(sh));
+            m.bytes += (size_t)sh.length * sh.repeat;
+            p += sizeof(sh) + sh.length;
+        }
+        return m;
+    }
+
+    // Descarta los registros más viejos que se pisan al escribir [from, to)
+    void evict(uint64_t from, uint64_t to) {
+        while (!order.empty()) {
+            const Entry& e = order.front();
+            if (e.offset >= to || e.offset + recordAt(e.offset).length <= from) break;
+            auto it = byId.find(e.jobId);
+            if (it != byId.end() && it->second == e.offset) byId.erase(it);
+            order.pop_front();
+        }
+    }
+
+    // Reconstruye el índice recorriendo desde el más viejo; false si el
+    // archivo no es coherente (se empieza de cero)
+    bool reindex() {
+        const uint64_t capacity = header->capacity;
+        if (header->head > capacity || header->tail > capacity) return false;
+
+        uint64_t p = header->tail;
+        for (uint64_t i = 0; i < header->count; i++) {
+            uint32_t magic = 0;
+            if (p + sizeof(uint32_t) <= capacity) std::memcpy(&magic, data + p, sizeof(magic));
+            if (p + sizeof(RecordHeader) > capacity || magic == WRAP) {
+                p = 0;
+                std::memcpy(&magic, data, sizeof(magic));
+            }
+            const RecordHeader& rh = recordAt(p);
+            if (magic != RECORD || rh.length < sizeof(RecordHeader) || p + rh.length > capacity ||
+                segmentsOf(rh) > data + p + rh.length)
+                return false;
+            order.push_back({p, rh.jobId});
+            byId[rh.jobId] = p;
+            p += rh.length;
+        }
+        return true;
+    }
+
+    bool map(const std::string& path, size_t total) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        size.QuadPart = (LONGLONG)total;
+        if (!SetFilePointerEx(file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            unmap();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, total) : nullptr;
+        if (!view) {
+            unmap();
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        if (::ftruncate(fd, (off_t)total) != 0) {
+            unmap();
+            return false;
+        }
+        void* view = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) {
+            unmap();
+            return false;
+        }
+#endif
+        base = static_cast<uint8_t*>(view);
+        mappedBytes = total;
+        return true;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (mappedBytes) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (mappedBytes) ::munmap(base, mappedBytes);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        mappedBytes = 0;
+    }
+};
@@ -0,0 +1,637 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// HistoryStore - Historial comprimido e indexado de lo impreso
+// ============================================================================
+//
+// Cada trabajo impreso se agrega a un archivo de sólo-agregado
+// (printagent.history) con sus bytes ESC/POS comprimidos (LzCodec contra un
+// diccionario de tickets recientes). Al arrancar se relee el archivo, se
+// descomprime cada trabajo para sacar sus términos y se arma en memoria:
+//   - un índice invertido término -> trabajos (en orden de llegada),
+//   - y los tiempos en orden, para acotar por rango con búsqueda binaria.
+// "Todo lo de la mesa 12 desde las 20:00" es una intersección de listas
+// dentro de un rango: milisegundos aunque haya meses de historial.
+//
+// Términos: cada palabra del texto en minúsculas, y además "table:N"
+// (después de "mesa"/"table"), "order:N" (después de "pedido", "orden",
+// "comanda", "order"), "ticket:<ticket_id>" y "printer:<impresora>".
+//
+// El diccionario se entrena con los primeros tickets y se reentrena cada
+// RETRAIN_EVERY trabajos; cada uno queda grabado en el archivo, así los
+// registros viejos siguen descomprimiéndose con el suyo.
+//
+// La escritura la hace un hilo propio: el hilo de la impresora sólo encola.
+
+#pragma once
+
+#include "alloc_tracker.h"
+#include "escpos_printer.h"
+#include "job_tracker.h"
+#include "logger.h"
+#include "lz_codec.h"
+#include "print_queue.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class HistoryStore {
+public:
+    struct Hit {
+        uint64_t jobId = 0;
+        int64_t  time  = 0;         // epoch ms
+        std::string printer;
+        std::string ticket;
+        size_t   bytes = 0;         // bytes impresos (con repeticiones)
+    };
+
+    struct Record {
+        Hit meta;
+        std::vector<Segment> segments;
+    };
+
+    struct Query {
+        std::vector<std::string> terms;     // todos deben estar (AND)
+        int64_t since = 0;
+        int64_t until = std::numeric_limits<int64_t>::max();
+        size_t  limit = 100;
+    };
+
+    HistoryStore() = default;
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+    ~HistoryStore() { stop(); }
+
+    // "" = sin historial
+    void open(const std::string& historyPath) {
+        if (historyPath.empty()) return;
+        path = historyPath;
+
+        uint64_t valid = reindex();
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec) && std::filesystem::file_size(path, ec) > valid) {
+            LOG_WARN("Historial: se descarta un registro incompleto al final");
+            std::filesystem::resize_file(path, valid, ec);
+        }
+        if (skipped)
+            LOG_WARN("Historial: {} registros dañados salteados", skipped);
+
+        out.open(path, std::ios::binary | std::ios::app);
+        if (!out) {
+            LOG_ERROR("No se pudo abrir el historial {}", path);
+            return;
+        }
+        if (valid == 0) {
+            out.write(MAGIC, sizeof(MAGIC));
+            out.flush();
+            fileSize = sizeof(MAGIC);
+        }
+        enabled = true;
+        if (!entries.empty())
+            LOG_INFO("Historial: {} trabajos", entries.size());
+    }
+
+    void start() {
+        if (enabled) writer = std::thread([this] { run(); });
+    }
+
+    // Termina de grabar lo pendiente
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (writer.joinable()) writer.join();
+    }
+
+    // Hilo de la impresora: sólo encola (se descarta si el disco no da abasto)
+    void append(const PrintJobPtr& job, const std::string& printer) {
+        if (!enabled || job->stream) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (pending.size() >= MAX_PENDING) {
+            dropped++;
+            return;
+        }
+        pending.push_back({job, printer, JobTracker::epochMs()});
+        cv.notify_one();
+    }
+
+    // Los más recientes primero
+    std::vector<Hit> search(const Query& q) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<Hit> hits;
+
+        auto byTime = [](const Entry& e, int64_t t) { return e.time < t; };
+        const uint32_t lo = (uint32_t)(std::lower_bound(entries.begin(), entries.end(), q.since, byTime) - entries.begin());
+        const uint32_t hi = (uint32_t)(std::upper_bound(entries.begin(), entries.end(), q.until,
+            [](int64_t t, const Entry& e) { return t < e.time; }) - entries.begin());
+        if (lo >= hi) return hits;
+
+        if (q.terms.empty()) {
+            for (uint32_t i = hi; i > lo && hits.size() < q.limit; i--) hits.push_back(hitOf(entries[i - 1]));
+            return hits;
+        }
+
+        // Se recorre la lista más corta y se verifica en las demás
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (auto& t : q.terms) {
+            auto it = postings.find(t);
+            if (it == postings.end()) return hits;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+
+        const std::vector<uint32_t>& shortest = *lists.front();
+        auto first = std::lower_bound(shortest.begin(), shortest.end(), lo);
+        for (auto it = std::lower_bound(first, shortest.end(), hi); it != first && hits.size() < q.limit;) {
+            const uint32_t ord = *--it;
+            bool all = std::all_of(lists.begin() + 1, lists.end(), [ord](auto* l) {
+                return std::binary_search(l->begin(), l->end(), ord);
+            });
+            if (all) hits.push_back(hitOf(entries[ord]));
+        }
+        return hits;
+    }
+
+    // Bytes de un trabajo del historial (se leen del archivo)
+    bool find(uint64_t jobId, Record& rec) const {
+        uint64_t offset;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = byJob.find(jobId);
+            if (it == byJob.end()) return false;
+            offset   = entries[it->second].offset;
+            rec.meta = hitOf(entries[it->second]);
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        std::vector<uint8_t> buf;
+        if (!in.seekg((std::streamoff)offset) || !readRecord(in, buf)) return false;
+
+        Decoded d;
+        if (!decode(buf, d)) return false;
+        rec.segments = std::move(d.segments);
+        return true;
+    }
+
+    // Texto imprimible de un trabajo del historial
+    bool text(uint64_t jobId, std::string& out) const {
+        Record rec;
+        if (!find(jobId, rec)) return false;
+        out.clear();
+        for (auto& s : rec.segments) out += ESCPOSPrinter::plainText(s.bytes->data(), s.bytes->size());
+        return true;
+    }
+
+    uint64_t lastJobId() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        uint64_t last = 0;
+        for (auto& [id, _] : byJob) last = std::max(last, id);
+        return last;
+    }
+
+    struct Stats {
+        size_t   jobs       = 0;
+        uint64_t fileBytes  = 0;
+        uint64_t rawBytes   = 0;    // sin comprimir, de lo agregado en esta ejecución
+        uint64_t storedBytes = 0;   // comprimido, ídem
+        size_t   terms      = 0;
+        size_t   dicts      = 0;
+        uint64_t dropped    = 0;
+    };
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return {entries.size(), fileSize, rawBytes, storedBytes, postings.size(),
+                dicts.size() - 1, dropped};
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    // Normaliza una palabra para buscar (minúsculas ASCII)
+    static std::string lower(std::string s) {
+        for (auto& c : s) if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        return s;
+    }
+
+    // Términos de un texto: palabras y "table:N" / "order:N"
+    static std::vector<std::string> termsOf(const std::string& text) {
+        std::vector<std::string> terms, words;
+        std::string word;
+        auto flush = [&] {
+            if (word.empty()) return;
+            words.push_back(lower(word));
+            word.clear();
+        };
+        for (unsigned char c : text) {
+            if (std::isalnum(c) || c >= 0x80) word += (char)c;
+            else flush();
+        }
+        flush();
+
+        for (size_t i = 0; i < words.size(); i++) {
+            const std::string& w = words[i];
+            if (w.size() >= 2 || std::isdigit((unsigned char)w[0])) terms.push_back(w);
+            if (i == 0 || w.find_first_not_of("0123456789") != std::string::npos) continue;
+            const std::string& prev = words[i - 1];
+            if (prev == "mesa" || prev == "table")
+                terms.push_back("table:" + w);
+            else if (prev == "pedido" || prev == "orden" || prev == "comanda" || prev == "order")
+                terms.push_back("order:" + w);
+        }
+        return terms;
+    }
+
+private:
+    static constexpr char     MAGIC[8] = {'H', 'I', 'V', 'A', 'H', 'S', '1', 0};
+    static constexpr uint32_t JOB  = 0x434A4948;        // "HIJC"
+    static constexpr uint32_t DICT = 0x43444948;        // "HIDC"
+    static constexpr size_t   MAX_PENDING   = 10000;
+    static constexpr size_t   MAX_RECORD    = 64 * 1024 * 1024;
+    static constexpr size_t   DICT_BYTES    = 16 * 1024;
+    static constexpr size_t   TRAIN_SAMPLES = 64;       // tickets para el primer diccionario
+    static constexpr size_t   RETRAIN_EVERY = 5000;
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t length;        // con este encabezado
+    };
+
+    struct JobHeader {
+        uint64_t jobId;
+        int64_t  time;
+        uint32_t rawLen;
+        uint32_t bytes;         // impresos, con repeticiones
+        uint16_t dictId;
+        uint16_t segments;
+        uint8_t  printerLen;
+        uint8_t  ticketLen;
+        uint16_t reserved;
+    };
+
+    struct SegmentHeader {
+        uint32_t repeat;
+        uint32_t length;
+    };
+
+    struct Entry {
+        uint64_t offset = 0;
+        int64_t  time   = 0;
+        uint64_t jobId  = 0;
+        uint32_t bytes  = 0;
+        uint16_t printer = 0;       // índice en `printers`
+        std::string ticket;
+    };
+
+    struct Pending {
+        PrintJobPtr job;
+        std::string printer;
+        int64_t time;
+    };
+
+    // Registro de trabajo leído y descomprimido
+    struct Decoded {
+        JobHeader header;
+        std::string printer;
+        std::string ticket;
+        std::vector<Segment> segments;
+    };
+
+    struct Reader {
+        const uint8_t* p;
+        size_t left;
+
+        template <typename T>
+        bool get(T& v) {
+            if (left < sizeof(T)) return false;
+            std::memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+            left -= sizeof(T);
+            return true;
+        }
+
+        bool str(size_t n, std::string& s) {
+            if (left < n) return false;
+            s.assign((const char*)p, n);
+            p += n;
+            left -= n;
+            return true;
+        }
+    };
+
+    using DictPtr = std::shared_ptr<const LzCodec::Dictionary>;
+
+    std::string path;
+    bool enabled = false;
+    std::ofstream out;                  // sólo el hilo escritor (y open)
+    std::thread writer;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Pending> pending;
+    bool stopping = false;
+
+    std::vector<Entry> entries;         // en orden de llegada (y de tiempo)
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+    std::unordered_map<uint64_t, uint32_t> byJob;
+    std::vector<std::string> printers;
+    std::vector<DictPtr> dicts{std::make_shared<const LzCodec::Dictionary>()};  // 0 = sin diccionario
+    uint64_t fileSize = 0;
+    uint64_t skipped = 0;                   // registros dañados al abrir
+    uint64_t rawBytes = 0, storedBytes = 0;
+    uint64_t dropped = 0;
+
+    // Del hilo escritor
+    std::deque<std::vector<uint8_t>> samples;   // tickets recientes para entrenar
+    size_t sinceTrain = 0;
+
+    Hit hitOf(const Entry& e) const {
+        return {e.jobId, e.time, printers[e.printer], e.ticket, e.bytes};
+    }
+
+    static bool readRecord(std::istream& in, std::vector<uint8_t>& buf) {
+        RecordHeader rh;
+        if (!in.read((char*)&rh, sizeof(rh))) return false;
+        if ((rh.magic != JOB && rh.magic != DICT) || rh.length < sizeof(rh) || rh.length > MAX_RECORD)
+            return false;
+        buf.resize(rh.length);
+        std::memcpy(buf.data(), &rh, sizeof(rh));
+        return (bool)in.read((char*)buf.data() + sizeof(rh), rh.length - sizeof(rh));
+    }
+
+    // Parsea y descomprime un registro de trabajo
+    bool decode(const std::vector<uint8_t>& buf, Decoded& d) const {
+        Reader r{buf.data() + sizeof(RecordHeader), buf.size() - sizeof(RecordHeader)};
+        JobHeader& h = d.header;
+        if (!r.get(h) || !r.str(h.printerLen, d.printer) || !r.str(h.ticketLen, d.ticket)) return false;
+        if (h.rawLen > MAX_RECORD) return false;
+
+        DictPtr dict;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (h.dictId >= dicts.size() || !dicts[h.dictId]) return false;
+            dict = dicts[h.dictId];
+        }
+
+        std::vector<SegmentHeader> segs(h.segments);
+        for (auto& s : segs) if (!r.get(s)) return false;
+
+        std::vector<uint8_t> raw;
+        if (!LzCodec::decompress(r.p, r.left, *dict, h.rawLen, raw)) return false;
+
+        d.segments.clear();
+        size_t at = 0;
+        for (auto& s : segs) {
+            if (s.length > raw.size() - at) return false;
+            d.segments.push_back({std::make_shared<const std::vector<BYTE>>(
+                raw.begin() + at, raw.begin() + at + s.length), (int)s.repeat});
+            at += s.length;
+        }
+        return true;
+    }
+
+    // Términos de un trabajo: su texto, el ticket_id y la impresora
+    static std::vector<std::string> termsFor(const std::vector<Segment>& segments,
+                                             const std::string& ticket, const std::string& printer)
+    {
+        std::string text;
+        for (auto& seg : segments) {
+            text += ESCPOSPrinter::plainText(seg.bytes->data(), seg.bytes->size());
+            text += '\n';
+        }
+        std::vector<std::string> terms = termsOf(text);
+        if (!ticket.empty()) terms.push_back("ticket:" + lower(ticket));
+        terms.push_back("printer:" + lower(printer));
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        return terms;
+    }
+
+    // Relee el archivo y arma los índices; devuelve el largo válido. Los
+    // términos no se guardan: se recalculan descomprimiendo cada trabajo.
+    // Un registro dañado con registros sanos después se saltea (quedan sus
+    // bytes, nadie los apunta); sólo se descarta lo que sigue al último sano.
+    uint64_t reindex() {
+        std::ifstream in(path, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        if (!in || !in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+            return 0;
+
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        uint64_t offset = sizeof(MAGIC), valid = offset;
+        std::vector<uint8_t> buf;
+        Decoded d;
+        while (offset < size) {
+            in.clear();
+            in.seekg((std::streamoff)offset);
+            if (readRecord(in, buf) && load(buf, offset, d)) {
+                offset += buf.size();
+                valid = offset;
+                continue;
+            }
+            offset = resync(in, offset + 1, size);
+            if (offset < size) skipped++;
+        }
+        fileSize = valid;
+        return valid;
+    }
+
+    // Carga un registro leído en `offset` en los índices; false si está dañado
+    bool load(const std::vector<uint8_t>& buf, uint64_t offset, Decoded& d) {
+        const uint32_t kind = reinterpret_cast<const RecordHeader*>(buf.data())->magic;
+        if (kind == DICT) {
+            Reader r{buf.data() + sizeof(RecordHeader), buf.size() - sizeof(RecordHeader)};
+            uint32_t id;
+            if (!r.get(id) || id < dicts.size() || id > 0xFFFF) return false;
+            dicts.resize(id);       // diccionarios perdidos: sus trabajos no decodifican
+            dicts.push_back(std::make_shared<const LzCodec::Dictionary>(
+                std::vector<uint8_t>(r.p, r.p + r.left)));
+            return true;
+        }
+        if (!decode(buf, d)) return false;
+        index(d.header, d.printer, d.ticket, termsFor(d.segments, d.ticket, d.printer), offset);
+        return true;
+    }
+
+    // Próxima posición desde `from` donde empieza un registro que se puede
+    // leer entero; `size` si no hay ninguno
+    uint64_t resync(std::ifstream& in, uint64_t from, uint64_t size) {
+        std::vector<char> block(64 * 1024);
+        std::vector<uint8_t> buf;
+        for (uint64_t at = from; at + sizeof(RecordHeader) <= size;) {
+            in.clear();
+            in.seekg((std::streamoff)at);
+            in.read(block.data(), (std::streamsize)block.size());
+            const size_t n = (size_t)in.gcount();
+            if (n < sizeof(uint32_t)) break;
+            for (size_t i = 0; i + sizeof(uint32_t) <= n; i++) {
+                uint32_t m;
+                std::memcpy(&m, block.data() + i, sizeof(m));
+                if (m != JOB && m != DICT) continue;
+                in.clear();
+                in.seekg((std::streamoff)(at + i));
+                if (readRecord(in, buf)) return at + i;
+            }
+            at += n - (sizeof(uint32_t) - 1);   // una marca puede quedar partida entre bloques
+        }
+        return size;
+    }
+
+    // Con mtx tomado (o antes de arrancar el hilo escritor)
+    void index(const JobHeader& h, const std::string& printer, const std::string& ticket,
+               const std::vector<std::string>& terms, uint64_t offset)
+    {
+        Entry e;
+        e.offset  = offset;
+        e.time    = entries.empty() ? h.time : std::max(h.time, entries.back().time);
+        e.jobId   = h.jobId;
+        e.bytes   = h.bytes;
+        e.printer = internPrinter(printer);
+        e.ticket  = ticket;
+
+        const uint32_t ord = (uint32_t)entries.size();
+        for (auto& t : terms) postings[t].push_back(ord);
+        byJob[e.jobId] = ord;
+        entries.push_back(std::move(e));
+    }
+
+    uint16_t internPrinter(const std::string& name) {
+        auto it = std::find(printers.begin(), printers.end(), name);
+        if (it != printers.end()) return (uint16_t)(it - printers.begin());
+        printers.push_back(name);
+        return (uint16_t)(printers.size() - 1);
+    }
+
+    void run() {
+        AllocTracker::setStage(AllocStageId::Record);
+        for (;;) {
+            Pending p;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) return;
+                p = std::move(pending.front());
+                pending.pop_front();
+            }
+            write(p);
+        }
+    }
+
+    template <typename T>
+    static void put(std::vector<uint8_t>& b, const T& v) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+        b.insert(b.end(), p, p + sizeof(T));
+    }
+
+    static void put(std::vector<uint8_t>& b, const std::string& s) {
+        b.insert(b.end(), s.begin(), s.end());
+    }
+
+    // Una escritura a medias se recorta hasta fileSize: lo siguiente no
+    // puede quedar detrás de bytes rotos
+    bool append(const std::vector<uint8_t>& rec) {
+        if (out.write((const char*)rec.data(), rec.size()) && out.flush()) return true;
+        LOG_ERROR("Error al escribir el historial");
+        out.close();
+        std::error_code ec;
+        std::filesystem::resize_file(path, fileSize, ec);
+        if (ec) LOG_ERROR("No se pudo recortar el historial: {}", ec.message());
+        out.open(path, std::ios::binary | std::ios::app);
+        return false;
+    }
+
+    void write(const Pending& p) {
+        const PrintJob& job = *p.job;
+        if (job.segments.size() > 0xFFFF) return;
+
+        std::vector<uint8_t> raw;
+        size_t printed = 0;
+        for (auto& seg : job.segments) {
+            raw.insert(raw.end(), seg.bytes->begin(), seg.bytes->end());
+            printed += seg.printSize();
+        }
+        if (raw.size() > MAX_RECORD / 2) return;
+
+        train(raw);
+        const DictPtr dict = dicts.back();      // sólo este hilo agrega
+        std::vector<uint8_t> packed = LzCodec::compress(raw.data(), raw.size(), *dict);
+
+        const std::string printer = p.printer.substr(0, 0xFF);
+        const std::string ticket  = job.ticket.substr(0, 0xFF);
+
+        JobHeader h{};
+        h.jobId      = job.id;
+        h.time       = p.time;
+        h.rawLen     = (uint32_t)raw.size();
+        h.bytes      = (uint32_t)std::min<size_t>(printed, UINT32_MAX);
+        h.dictId     = (uint16_t)(dicts.size() - 1);
+        h.segments   = (uint16_t)job.segments.size();
+        h.printerLen = (uint8_t)printer.size();
+        h.ticketLen  = (uint8_t)ticket.size();
+
+        std::vector<uint8_t> rec;
+        put(rec, RecordHeader{JOB, 0});
+        put(rec, h);
+        put(rec, printer);
+        put(rec, ticket);
+        for (auto& seg : job.segments)
+            put(rec, SegmentHeader{(uint32_t)seg.repeat, (uint32_t)seg.bytes->size()});
+        rec.insert(rec.end(), packed.begin(), packed.end());
+        const uint32_t length = (uint32_t)rec.size();
+        std::memcpy(rec.data() + offsetof(RecordHeader, length), &length, sizeof(length));
+
+        if (!append(rec)) return;
+
+        auto terms = termsFor(job.segments, ticket, printer);
+        std::lock_guard<std::mutex> lock(mtx);
+        index(h, printer, ticket, terms, fileSize);
+        fileSize += rec.size();
+        rawBytes += raw.size();
+        storedBytes += rec.size();
+    }
+
+    // Junta tickets recientes y arma un diccionario nuevo con los que
+    // aportan material que el diccionario en armado todavía no tiene
+    void train(const std::vector<uint8_t>& raw) {
+        if (raw.empty()) return;
+        samples.push_back(raw);
+        if (samples.size() > TRAIN_SAMPLES) samples.pop_front();
+
+        const bool first = dicts.size() == 1;
+        if (++sinceTrain < (first ? TRAIN_SAMPLES : RETRAIN_EVERY) || dicts.size() > 0xFFFF) return;
+        sinceTrain = 0;
+
+        std::vector<uint8_t> dict;
+        for (auto it = samples.rbegin(); it != samples.rend() && dict.size() < DICT_BYTES; ++it) {
+            size_t packed = LzCodec::compress(it->data(), it->size(), LzCodec::Dictionary(dict)).size();
+            if (packed * 2 < it->size()) continue;      // ya lo cubre
+            size_t take = std::min(it->size(), DICT_BYTES - dict.size());
+            dict.insert(dict.begin(), it->begin(), it->begin() + take);
+        }
+
+        std::vector<uint8_t> rec;
+        put(rec, RecordHeader{DICT, (uint32_t)(sizeof(RecordHeader) + sizeof(uint32_t) + dict.size())});
+        put(rec, (uint32_t)dicts.size());
+        rec.insert(rec.end(), dict.begin(), dict.end());
+        if (!append(rec)) return;
+
+        auto prepared = std::make_shared<const LzCodec::Dictionary>(dict);
+        std::lock_guard<std::mutex> lock(mtx);
+        dicts.push_back(std::move(prepared));
+        fileSize += rec.size();
+    }
+};
@@ -0,0 +1,178 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// JobTracker - Estado de los trabajos y difusión de eventos
+// ============================================================================
+//
+// Cada cambio de estado (queued, encoding, sent, printed, failed, ...) se
+// guarda en el mapa por id, para GET /jobs/{id}, y se agrega una sola vez a
+// un anillo de difusión como frame SSE ya armado. Cada suscriptor de
+// /events sólo guarda su cursor (número de secuencia) y toma referencias a
+// los frames: no hay copias por suscriptor. Un suscriptor que se atrasa más
+// que el anillo salta al evento más viejo disponible y recibe un aviso.
+//
+// Se conservan los últimos `retain` trabajos terminados; los más viejos se
+// olvidan (GET /jobs/{id} da 404).
+
+#pragma once
+
+#include "json.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class JobState { Prepared, Scheduled, Queued, Encoding, Sent, Printed, Failed, Cancelled, Expired };
+
+inline const char* jobStateName(JobState s) {
+    switch (s) {
+        case JobState::Prepared:  return "prepared";
+        case JobState::Scheduled: return "scheduled";
+        case JobState::Queued:    return "queued";
+        case JobState::Encoding:  return "encoding";
+        case JobState::Sent:      return "sent";
+        case JobState::Printed:   return "printed";
+        case JobState::Failed:    return "failed";
+        case JobState::Cancelled: return "cancelled";
+        default:                  return "expired";
+    }
+}
+
+inline bool parseJobState(const std::string& s, JobState& out) {
+    for (int i = 0; i <= (int)JobState::Expired; i++) {
+        if (s == jobStateName((JobState)i)) {
+            out = (JobState)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool isTerminal(JobState s) {
+    return s == JobState::Printed || s == JobState::Failed || s == JobState::Cancelled ||
+           s == JobState::Expired;
+}
+
+class JobTracker {
+public:
+    struct Status {
+        JobState state = JobState::Queued;
+        std::string printer;
+        int64_t updatedAt = 0;      // epoch ms
+    };
+
+    using Frame = std::shared_ptr<const std::string>;
+
+    explicit JobTracker(size_t ringSize = 4096, size_t retain = 10000)
+        : ring(ringSize), retain(retain) {}
+
+    void publish(uint64_t id, JobState state, const std::string& printer = "") {
+        const int64_t now = epochMs();
+        std::lock_guard<std::mutex> lock(mtx);
+
+        Status& st = jobs[id];
+        st.state = state;
+        if (!printer.empty()) st.printer = printer;
+        st.updatedAt = now;
+
+        if (isTerminal(state)) {
+            finished.push_back(id);
+            while (finished.size() > retain) {
+                auto it = jobs.find(finished.front());
+                if (it != jobs.end() && isTerminal(it->second.state)) jobs.erase(it);
+                finished.pop_front();
+            }
+        }
+
+        ring[nextSeq % ring.size()] = std::make_shared<const std::string>(
+            frame(nextSeq, id, st));
+        nextSeq++;
+        cv.notify_all();
+    }
+
+    bool status(uint64_t id, Status& out) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    // Long-poll: espera hasta que el estado deje de ser `seen` (o, sin
+    // `seen`, hasta un estado final) o venza el plazo. false si no existe.
+    bool waitChange(uint64_t id, const JobState* seen, std::chrono::milliseconds timeout, Status& out) {
+        std::unique_lock<std::mutex> lock(mtx);
+        auto changed = [&] {
+            auto it = jobs.find(id);
+            if (it == jobs.end()) return true;
+            return seen ? it->second.state != *seen : isTerminal(it->second.state);
+        };
+        cv.wait_for(lock, timeout, [&] { return stopping || changed(); });
+
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    // Secuencia del próximo evento (cursor inicial de un suscriptor nuevo)
+    uint64_t head() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return nextSeq;
+    }
+
+    // Frames desde `cursor`, esperando hasta `timeout` si no hay ninguno.
+    // `lost` indica que el suscriptor se atrasó y se saltearon eventos.
+    void read(uint64_t& cursor, std::chrono::milliseconds timeout,
+              std::vector<Frame>& out, bool& lost)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock, timeout, [&] { return stopping || cursor < nextSeq; });
+
+        lost = false;
+        if (cursor > nextSeq) cursor = nextSeq;     // Last-Event-ID de otra ejecución
+        if (nextSeq - cursor > ring.size()) {
+            cursor = nextSeq - ring.size();
+            lost = true;
+        }
+        for (; cursor < nextSeq; cursor++) out.push_back(ring[cursor % ring.size()]);
+    }
+
+    // Despierta a los long-polls y suscriptores para poder cerrar
+    void shutdown() {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        cv.notify_all();
+    }
+
+    bool isStopping() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stopping;
+    }
+
+    static int64_t epochMs() {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::unordered_map<uint64_t, Status> jobs;
+    std::deque<uint64_t> finished;
+    std::vector<Frame> ring;
+    uint64_t nextSeq = 1;
+    size_t retain;
+    bool stopping = false;
+
+    // Frame SSE: los ids de evento permiten retomar con Last-Event-ID
+    static std::string frame(uint64_t seq, uint64_t id, const Status& st) {
+        nlohmann::json data = {{"job_id", id}, {"state", jobStateName(st.state)}, {"ts", st.updatedAt}};
+        if (!st.printer.empty()) data["printer"] = st.printer;
+        return "id: " + std::to_string(seq) + "\nevent: job\ndata: " + data.dump() + "\n\n";
+    }
+};
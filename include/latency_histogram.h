@@ -0,0 +1,80 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// LatencyHistogram - Histograma log-lineal de latencias en microsegundos
+// ============================================================================
+//
+// Cubeta = potencia de 2 subdividida en 16 partes: error relativo < 6,25 %
+// con memoria fija, sin guardar las muestras. No es thread-safe; quien lo
+// use lo protege con su propio mutex.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+    void record(uint64_t micros) {
+        buckets[indexOf(micros)]++;
+        total++;
+        sum += micros;
+        maxValue = std::max(maxValue, micros);
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < BUCKETS; i++) buckets[i] += o.buckets[i];
+        total += o.total;
+        sum += o.sum;
+        maxValue = std::max(maxValue, o.maxValue);
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return total ? (double)sum / total : 0.0; }
+
+    // Valor (límite superior de la cubeta) bajo el que cae el percentil p (0-100)
+    uint64_t percentile(double p) const {
+        if (!total) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, total);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(upperBound(i), maxValue);
+        }
+        return maxValue;
+    }
+
+private:
+    static constexpr size_t SUB     = 16;
+    static constexpr size_t BUCKETS = 64 * SUB;
+
+    std::array<uint64_t, BUCKETS> buckets{};
+    uint64_t total    = 0;
+    uint64_t sum      = 0;
+    uint64_t maxValue = 0;
+
+    static int log2floor(uint64_t v) {
+        int r = 0;
+        while (v >>= 1) r++;
+        return r;
+    }
+
+    static size_t indexOf(uint64_t v) {
+        if (v < SUB) return (size_t)v;
+        int exp = log2floor(v);                          // >= 4
+        uint64_t sub = (v >> (exp - 4)) & (SUB - 1);     // 4 bits debajo del MSB
+        return std::min<size_t>((size_t)(exp - 3) * SUB + sub, BUCKETS - 1);
+    }
+
+    static uint64_t upperBound(size_t idx) {
+        if (idx < SUB) return idx;
+        int exp = (int)(idx / SUB) + 3;
+        uint64_t sub = idx % SUB;
+        return ((SUB + sub + 1) << (exp - 4)) - 1;
+    }
+};
@@ -0,0 +1,452 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Logger - Log asíncrono: anillos por hilo y un hilo que formatea y escribe
+// ============================================================================
+//
+// LOG_INFO("Impresora {} sin respuesta", name) no formatea ni escribe: copia
+// el puntero al formato y los argumentos en binario al anillo del hilo (un
+// SPSC sin locks: escribe sólo ese hilo, lee sólo el de fondo). El hilo de
+// fondo junta los anillos cada FLUSH_EVERY, ordena por tiempo, formatea y
+// escribe a la consola y al archivo, que rota por tamaño
+// (printagent.log -> printagent.log.1 -> ...). Con el anillo lleno el
+// mensaje se descarta y se cuenta: loguear nunca bloquea a quien imprime.
+//
+// El nivel mínimo se fija al compilar (-DHIVA_LOG_LEVEL=2 deja info y
+// más graves); los LOG_* por debajo no generan código. La consola muestra
+// desde "console" (info por omisión); el archivo, todo lo compilado.
+//
+// Los formatos tienen que ser literales: se guarda el puntero, no el texto.
+
+#pragma once
+
+#include "alloc_tracker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t { Trace = 0, Debug = 1, Info = 2, Warn = 3, Error = 4 };
+
+#ifndef HIVA_LOG_LEVEL
+#define HIVA_LOG_LEVEL 1        // debug
+#endif
+
+#define HIVA_LOG(level, ...) \
+    do { if constexpr ((int)(level) >= HIVA_LOG_LEVEL) ::Logger::log(level, __VA_ARGS__); } while (0)
+
+#define LOG_TRACE(...) HIVA_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) HIVA_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  HIVA_LOG(LogLevel::Info,  __VA_ARGS__)
+#define LOG_WARN(...)  HIVA_LOG(LogLevel::Warn,  __VA_ARGS__)
+#define LOG_ERROR(...) HIVA_LOG(LogLevel::Error, __VA_ARGS__)
+
+inline const char* logLevelName(LogLevel l) {
+    switch (l) {
+        case LogLevel::Trace: return "TRACE";
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info:  return "INFO ";
+        case LogLevel::Warn:  return "WARN ";
+        case LogLevel::Error: return "ERROR";
+    }
+    return "?";
+}
+
+inline bool parseLogLevel(const std::string& s, LogLevel& out) {
+    static const char* names[] = {"trace", "debug", "info", "warn", "error"};
+    for (int i = 0; i < 5; i++) {
+        if (s == names[i]) {
+            out = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct LogSettings {
+    std::string path = "printagent.log";    // "" = sólo consola
+    size_t maxBytes  = 8 * 1024 * 1024;     // por archivo, antes de rotar
+    int files        = 5;                   // archivos rotados que se guardan
+    LogLevel console = LogLevel::Info;
+};
+
+class Logger {
+public:
+    template <size_t N, typename... Args>
+    static void log(LogLevel level, const char (&fmt)[N], const Args&... args) {
+        Logger& l = instance();
+        Ring& ring = l.local();
+
+        const size_t size = align(sizeof(Header) + (argSize(args) + ... + 0));
+        uint8_t* p = ring.reserve(size);
+        if (!p) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Header h{};
+        h.size  = (uint32_t)size;
+        h.level = (uint8_t)level;
+        h.nargs = (uint8_t)sizeof...(Args);
+        h.time  = nowNs();
+        h.fmt   = fmt;
+        std::memcpy(p, &h, sizeof(h));
+        uint8_t* at = p + sizeof(h);
+        (putArg(at, args), ...);
+        (void)at;
+        ring.commit(size);
+
+        // Errores enseguida; y con el anillo a medio llenar, antes de que descarte
+        if (level >= LogLevel::Error || ring.used() > RING_BYTES / 2) l.wake();
+    }
+
+    // Abre el archivo de log (antes, sólo consola)
+    static void configure(const LogSettings& s) {
+        Logger& l = instance();
+        std::lock_guard<std::mutex> lock(l.sinkMtx);
+        l.settings = s;
+        l.openFile();
+    }
+
+    // Escribe lo pendiente y termina el hilo de fondo (al salir de main)
+    static void shutdown() {
+        Logger& l = instance();
+        {
+            std::lock_guard<std::mutex> lock(l.mtx);
+            if (l.stopping) return;
+            l.stopping = true;
+        }
+        l.cv.notify_all();
+        if (l.flusher.joinable()) l.flusher.join();
+    }
+
+    static uint64_t dropped() { return instance().droppedTotal.load(); }
+
+private:
+    static constexpr size_t RING_BYTES  = 64 * 1024;   // por hilo, potencia de 2
+    static constexpr size_t MAX_STRING  = 1024;        // argumentos más largos se recortan
+    static constexpr auto   FLUSH_EVERY = std::chrono::milliseconds(20);
+    static constexpr uint8_t PAD = 0xFF;               // relleno hasta el final del anillo
+
+    struct Header {
+        uint32_t size;          // con el encabezado y los argumentos, alineado a 8
+        uint8_t  level;
+        uint8_t  nargs;
+        uint16_t reserved;
+        uint64_t time;          // ns desde epoch
+        const char* fmt;
+    };
+
+    enum Tag : uint8_t { SIGNED, UNSIGNED, REAL, TEXT };
+
+    // Un productor (el hilo dueño) y un consumidor (el hilo de fondo).
+    // Los registros no se parten: si no entran al final se rellena y se
+    // sigue desde el principio.
+    struct Ring {
+        std::unique_ptr<uint8_t[]> data{new uint8_t[RING_BYTES]};
+        std::atomic<uint64_t> head{0};      // escribe el dueño
+        std::atomic<uint64_t> tail{0};      // escribe el hilo de fondo
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> alive{true};
+
+        uint8_t* reserve(size_t size) {
+            if (size > RING_BYTES / 2) return nullptr;
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            const uint64_t t = tail.load(std::memory_order_acquire);
+            const size_t at = h % RING_BYTES, room = RING_BYTES - at;
+            const size_t need = size <= room ? size : room + size;
+            if (RING_BYTES - (h - t) < need) return nullptr;
+            if (size > room) {
+                Header pad{};
+                pad.size  = (uint32_t)room;
+                pad.level = PAD;
+                std::memcpy(&data[at], &pad, sizeof(uint32_t) + 1);
+                head.store(h + room, std::memory_order_release);
+                return &data[0];
+            }
+            return &data[at];
+        }
+
+        void commit(size_t size) {
+            head.store(head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        }
+
+        size_t used() const {
+            return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct Owner {
+        std::shared_ptr<Ring> ring;
+        ~Owner() { if (ring) ring->alive.store(false); }
+    };
+
+    struct Line {
+        uint64_t time;
+        LogLevel level;
+        std::string text;
+    };
+
+    std::mutex mtx;                 // anillos y parada
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<Ring>> rings;
+    bool stopping = false;
+    std::atomic<bool> woken{false};
+    std::thread flusher;
+    std::atomic<uint64_t> droppedTotal{0};
+
+    std::mutex sinkMtx;             // configuración y archivo
+    LogSettings settings{"", 0, 0, LogLevel::Info};
+    std::FILE* file = nullptr;
+    size_t fileBytes = 0;
+
+    Logger() { flusher = std::thread([this] { run(); }); }
+
+    // Nunca se destruye: los objetos globales pueden loguear al destruirse
+    static Logger& instance() {
+        static Logger* l = new Logger();
+        return *l;
+    }
+
+    // Una sola notificación hasta que el hilo de fondo la atienda
+    void wake() {
+        if (!woken.exchange(true)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_one();
+        }
+    }
+
+    Ring& local() {
+        thread_local Owner owner;
+        if (!owner.ring) {
+            auto r = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(mtx);
+            rings.push_back(r);
+            owner.ring = std::move(r);
+        }
+        return *owner.ring;
+    }
+
+    static uint64_t nowNs() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static size_t align(size_t n) { return (n + 7) & ~size_t(7); }
+
+    template <typename T>
+    static size_t argSize(const T& v) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            return 1 + 8;
+        } else {
+            static_assert(std::is_convertible_v<const T&, std::string_view>,
+                          "LOG_*: argumento sin formato (numero o texto)");
+            return 1 + 4 + std::min(std::string_view(v).size(), MAX_STRING);
+        }
+    }
+
+    template <typename T>
+    static void putArg(uint8_t*& p, const T& v) {
+        if constexpr (std::is_floating_point_v<T>) {
+            *p++ = REAL;
+            double d = (double)v;
+            std::memcpy(p, &d, 8);
+            p += 8;
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            *p++ = SIGNED;
+            int64_t i = (int64_t)v;
+            std::memcpy(p, &i, 8);
+            p += 8;
+        } else if constexpr (std::is_integral_v<T>) {
+            *p++ = UNSIGNED;
+            uint64_t u = (uint64_t)v;
+            std::memcpy(p, &u, 8);
+            p += 8;
+        } else {
+            std::string_view s(v);
+            const uint32_t n = (uint32_t)std::min(s.size(), MAX_STRING);
+            *p++ = TEXT;
+            std::memcpy(p, &n, 4);
+            std::memcpy(p + 4, s.data(), n);
+            p += 4 + n;
+        }
+    }
+
+    // Reemplaza cada {} del formato por el siguiente argumento
+    static std::string format(const Header& h, const uint8_t* p) {
+        std::string out;
+        const char* f = h.fmt;
+        for (int i = 0; i < h.nargs; i++) {
+            const char* mark = std::strstr(f, "{}");
+            out.append(f, mark ? mark : f + std::strlen(f));
+            if (!mark) out += ' ';
+
+            const uint8_t tag = *p++;
+            if (tag == TEXT) {
+                uint32_t n;
+                std::memcpy(&n, p, 4);
+                out.append((const char*)p + 4, n);
+                p += 4 + n;
+            } else {
+                char num[32];
+                if (tag == REAL) {
+                    double d;
+                    std::memcpy(&d, p, 8);
+                    std::snprintf(num, sizeof(num), "%.3f", d);
+                } else if (tag == SIGNED) {
+                    int64_t v;
+                    std::memcpy(&v, p, 8);
+                    std::snprintf(num, sizeof(num), "%lld", (long long)v);
+                } else {
+                    uint64_t v;
+                    std::memcpy(&v, p, 8);
+                    std::snprintf(num, sizeof(num), "%llu", (unsigned long long)v);
+                }
+                out += num;
+                p += 8;
+            }
+            f = mark ? mark + 2 : f + std::strlen(f);
+        }
+        out += f;
+        return out;
+    }
+
+    void run() {
+        AllocTracker::setStage(AllocStageId::Log);
+        for (;;) {
+            bool last;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait_for(lock, FLUSH_EVERY, [this] { return stopping || woken.load(); });
+                woken.store(false);
+                last = stopping;
+            }
+            drain();
+            if (last) return;
+        }
+    }
+
+    void drain() {
+        std::vector<std::shared_ptr<Ring>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            // Los anillos de hilos terminados se sueltan ya vacíos
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [](auto& r) {
+                return !r->alive.load() &&
+                       r->head.load(std::memory_order_acquire) == r->tail.load(std::memory_order_relaxed);
+            }), rings.end());
+            snapshot = rings;
+        }
+
+        std::vector<Line> lines;
+        uint64_t lost = 0;
+        for (auto& r : snapshot) {
+            const uint64_t h = r->head.load(std::memory_order_acquire);
+            uint64_t t = r->tail.load(std::memory_order_relaxed);
+            while (t < h) {
+                const uint8_t* p = &r->data[t % RING_BYTES];
+                Header hd;
+                std::memcpy(&hd, p, sizeof(uint32_t) + 1);
+                if (hd.level != PAD) {
+                    std::memcpy(&hd, p, sizeof(hd));
+                    lines.push_back({hd.time, (LogLevel)hd.level, format(hd, p + sizeof(hd))});
+                }
+                t += hd.size;
+            }
+            r->tail.store(t, std::memory_order_release);
+            lost += r->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        if (lost) {
+            droppedTotal += lost;
+            lines.push_back({nowNs(), LogLevel::Warn,
+                             "Log: " + std::to_string(lost) + " mensajes descartados (anillo lleno)"});
+        }
+        if (lines.empty()) return;
+
+        std::stable_sort(lines.begin(), lines.end(),
+                         [](const Line& a, const Line& b) { return a.time < b.time; });
+        write(lines);
+    }
+
+    void write(const std::vector<Line>& lines) {
+        std::lock_guard<std::mutex> lock(sinkMtx);
+        bool out = false, err = false;
+        for (auto& l : lines) {
+            const std::string text = stamp(l.time) + " " + logLevelName(l.level) + " " + l.text + "\n";
+            if (l.level >= settings.console) {
+                std::FILE* con = l.level >= LogLevel::Warn ? stderr : stdout;
+                std::fwrite(text.data(), 1, text.size(), con);
+                (con == stderr ? err : out) = true;
+            }
+            if (file) {
+                if (settings.maxBytes && fileBytes + text.size() > settings.maxBytes) rotate();
+                if (file) {
+                    std::fwrite(text.data(), 1, text.size(), file);
+                    fileBytes += text.size();
+                }
+            }
+        }
+        if (out) std::fflush(stdout);
+        if (err) std::fflush(stderr);
+        if (file) std::fflush(file);
+    }
+
+    static std::string stamp(uint64_t ns) {
+        const std::time_t secs = (std::time_t)(ns / 1000000000);
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &secs);
+#else
+        localtime_r(&secs, &tm);
+#endif
+        char buf[40];
+        size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        std::snprintf(buf + n, sizeof(buf) - n, ".%03u", (unsigned)(ns / 1000000 % 1000));
+        return buf;
+    }
+
+    // Con sinkMtx tomado
+    void openFile() {
+        if (file) std::fclose(file);
+        file = nullptr;
+        fileBytes = 0;
+        if (settings.path.empty()) return;
+
+        file = std::fopen(settings.path.c_str(), "ab");
+        if (!file) {
+            std::fprintf(stderr, "[HIVA] No se pudo abrir el log %s\n", settings.path.c_str());
+            return;
+        }
+        std::error_code ec;
+        fileBytes = (size_t)std::filesystem::file_size(settings.path, ec);
+        if (ec) fileBytes = 0;
+    }
+
+    // printagent.log.(n-1) -> .n, ..., printagent.log -> .1 (con sinkMtx tomado)
+    void rotate() {
+        std::fclose(file);
+        file = nullptr;
+        std::error_code ec;
+        const std::string& base = settings.path;
+        if (settings.files <= 0) {
+            std::filesystem::remove(base, ec);
+        } else {
+            std::filesystem::remove(base + "." + std::to_string(settings.files), ec);
+            for (int i = settings.files - 1; i >= 1; i--)
+                std::filesystem::rename(base + "." + std::to_string(i), base + "." + std::to_string(i + 1), ec);
+            std::filesystem::rename(base, base + ".1", ec);
+        }
+        openFile();
+    }
+};
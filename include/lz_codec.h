@@ -0,0 +1,153 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// LzCodec - Compresión LZ77 con diccionario para el historial
+// ============================================================================
+//
+// Formato tipo LZ4: secuencias de [token][literales][offset 16 bits] con
+// largos extendidos en bytes de 255. La ventana empieza con un diccionario
+// (bytes de tickets recientes): las comandas repiten encabezados, comandos
+// ESC/POS y nombres de platos, así que hasta un ticket corto comprime bien
+// contra el diccionario, que es lo que da zstd con un diccionario entrenado.
+//
+// El largo original se guarda aparte; la última secuencia sólo trae
+// literales.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class LzCodec {
+public:
+    static constexpr size_t MAX_OFFSET = 65535;
+    static constexpr size_t MIN_MATCH  = 4;
+    static constexpr int      HASH_BITS = 14;
+    static constexpr uint32_t HASH_SIZE = 1u << HASH_BITS;
+
+    // Diccionario con su tabla de hash ya cargada: se arma una vez y sirve
+    // para todos los trabajos que se comprimen con él
+    struct Dictionary {
+        std::vector<uint8_t> bytes;     // a lo sumo los últimos MAX_OFFSET
+        std::vector<int32_t> head;
+
+        explicit Dictionary(const std::vector<uint8_t>& b = {})
+            : bytes(b.end() - std::min(b.size(), MAX_OFFSET), b.end()), head(HASH_SIZE, -1)
+        {
+            for (size_t i = 0; i + MIN_MATCH <= bytes.size(); i++) head[hash(&bytes[i])] = (int32_t)i;
+        }
+    };
+
+    static std::vector<uint8_t> compress(const uint8_t* src, size_t n, const Dictionary& dict) {
+        // Ventana = diccionario + entrada
+        std::vector<uint8_t> buf;
+        buf.reserve(dict.bytes.size() + n);
+        buf.insert(buf.end(), dict.bytes.begin(), dict.bytes.end());
+        buf.insert(buf.end(), src, src + n);
+        const size_t start = dict.bytes.size(), end = buf.size();
+
+        std::vector<int32_t> head = dict.head;
+
+        std::vector<uint8_t> out;
+        out.reserve(n / 2 + 16);
+        size_t i = start, anchor = start;
+        while (i + MIN_MATCH <= end) {
+            const uint32_t h = hash(&buf[i]);
+            const int32_t cand = head[h];
+            head[h] = (int32_t)i;
+
+            if (cand < 0 || i - cand > MAX_OFFSET || std::memcmp(&buf[cand], &buf[i], MIN_MATCH) != 0) {
+                i++;
+                continue;
+            }
+
+            size_t len = MIN_MATCH;
+            while (i + len < end && buf[cand + len] == buf[i + len]) len++;
+
+            emit(out, buf.data() + anchor, i - anchor, len, i - cand);
+            for (size_t k = i + 1; k < i + len && k + MIN_MATCH <= end; k++)
+                head[hash(&buf[k])] = (int32_t)k;
+            i += len;
+            anchor = i;
+        }
+        emit(out, buf.data() + anchor, end - anchor, 0, 0);
+        return out;
+    }
+
+    // false si los datos no son válidos para ese diccionario y largo. El
+    // diccionario no se copia: las referencias que caen antes del inicio
+    // de la salida se leen de él
+    static bool decompress(const uint8_t* src, size_t n, const Dictionary& dict,
+                           size_t rawLen, std::vector<uint8_t>& out)
+    {
+        const std::vector<uint8_t>& d = dict.bytes;
+        out.clear();
+        out.reserve(rawLen);
+
+        size_t p = 0;
+        while (p < n) {
+            const uint8_t token = src[p++];
+            size_t lit = token >> 4;
+            if (lit == 15 && !readLength(src, n, p, lit)) return false;
+            if (p + lit > n || out.size() + lit > rawLen) return false;
+            out.insert(out.end(), src + p, src + p + lit);
+            p += lit;
+
+            if (out.size() == rawLen) break;    // secuencia final
+
+            if (p + 2 > n) return false;
+            const size_t offset = src[p] | (src[p + 1] << 8);
+            p += 2;
+            size_t len = token & 15;
+            if (len == 15 && !readLength(src, n, p, len)) return false;
+            len += MIN_MATCH;
+            if (offset == 0 || offset > d.size() + out.size() || out.size() + len > rawLen) return false;
+
+            // Byte a byte: la copia puede solaparse con lo que escribe.
+            // `from` es la posición en diccionario + salida.
+            const size_t from = d.size() + out.size() - offset;
+            for (size_t k = 0; k < len; k++) {
+                const size_t at = from + k;
+                out.push_back(at < d.size() ? d[at] : out[at - d.size()]);
+            }
+        }
+        return out.size() == rawLen;
+    }
+
+private:
+    static uint32_t hash(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void writeLength(std::vector<uint8_t>& out, size_t len) {
+        for (; len >= 255; len -= 255) out.push_back(255);
+        out.push_back((uint8_t)len);
+    }
+
+    static bool readLength(const uint8_t* src, size_t n, size_t& p, size_t& len) {
+        for (;;) {
+            if (p >= n) return false;
+            uint8_t b = src[p++];
+            len += b;
+            if (b != 255) return true;
+        }
+    }
+
+    // `matchLen` 0 = secuencia final, sólo literales
+    static void emit(std::vector<uint8_t>& out, const uint8_t* lit, size_t litLen,
+                     size_t matchLen, size_t offset)
+    {
+        const size_t m = matchLen ? matchLen - MIN_MATCH : 0;
+        out.push_back((uint8_t)((std::min<size_t>(litLen, 15) << 4) | std::min<size_t>(m, 15)));
+        if (litLen >= 15) writeLength(out, litLen - 15);
+        out.insert(out.end(), lit, lit + litLen);
+        if (!matchLen) return;
+
+        out.push_back((uint8_t)(offset & 0xFF));
+        out.push_back((uint8_t)(offset >> 8));
+        if (m >= 15) writeLength(out, m - 15);
+    }
+};
@@ -0,0 +1,133 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// PreparedStore - Trabajos pre-codificados a la espera de confirmación
+// ============================================================================
+//
+// Impresión en dos fases: POST /jobs/prepare codifica el ticket mientras el
+// mozo todavía edita el pedido y devuelve un id; POST /jobs/{id}/commit sólo
+// lo encola, sin volver a codificar. El id es el del trabajo, así que el
+// mismo número sigue al trabajo hasta que se imprime.
+//
+// Lo no confirmado vence a los ttl_ms (rueda de temporizadores del spooler)
+// y hay un tope de trabajos y bytes retenidos.
+
+#pragma once
+
+#include "config.h"
+#include "job_tracker.h"
+#include "print_queue.h"
+#include "timer_wheel.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class PreparedStore {
+public:
+    // Opciones guardadas en la preparación; el commit puede pisarlas
+    struct Prepared {
+        PrintJobPtr job;
+        std::string printer;
+        std::string group;
+        std::chrono::steady_clock::time_point deadline;     // lo fija put()
+    };
+
+    PreparedStore(TimerService& timers, JobTracker& tracker, const QueueLimits& limits)
+        : timers(timers), tracker(tracker), limits(limits) {}
+
+    // false si no hay lugar
+    bool put(Prepared p, std::chrono::milliseconds ttl) {
+        const uint64_t id = p.job->id;
+        const size_t size = p.job->queuedSize();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (entries.size() + 1 > limits.maxJobs || heldBytes + size > limits.maxBytes)
+            return false;
+
+        Entry& e = entries[id];
+        e.prepared = std::move(p);
+        e.prepared.deadline = std::chrono::steady_clock::now() + ttl;
+        e.timer = timers.after(ttl, [this, id] {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = entries.find(id);
+            if (it == entries.end()) return;
+            heldBytes -= it->second.prepared.job->queuedSize();
+            entries.erase(it);
+            expired++;
+            tracker.publish(id, JobState::Expired);
+        });
+        heldBytes += size;
+        tracker.publish(id, JobState::Prepared, e.prepared.printer);
+        return true;
+    }
+
+    // Saca el trabajo para confirmarlo; false si no existe o venció
+    bool take(uint64_t id, Prepared& out) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(id);
+        if (it == entries.end()) return false;
+
+        timers.cancel(it->second.timer);
+        heldBytes -= it->second.prepared.job->queuedSize();
+        out = std::move(it->second.prepared);
+        entries.erase(it);
+        return true;
+    }
+
+    // Descarta un trabajo preparado (DELETE /jobs/{id})
+    bool discard(uint64_t id) {
+        Prepared p;
+        if (!take(id, p)) return false;
+        tracker.publish(id, JobState::Cancelled);
+        return true;
+    }
+
+    // Devuelve un trabajo sacado con take() cuyo commit fue rechazado
+    // (cola llena): el POS puede reintentar el commit. Conserva el
+    // vencimiento original; si ya pasó, queda vencido. false si entretanto
+    // se llenó el lugar que dejó: el trabajo queda fallido, no perdido en silencio
+    bool restore(Prepared p) {
+        using namespace std::chrono;
+        const uint64_t id = p.job->id;
+        const auto left = duration_cast<milliseconds>(p.deadline - steady_clock::now());
+        if (left.count() <= 0) {
+            tracker.publish(id, JobState::Expired);
+            return true;
+        }
+        if (put(std::move(p), left)) return true;
+        tracker.publish(id, JobState::Failed);
+        return false;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return entries.size();
+    }
+
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return heldBytes;
+    }
+
+    uint64_t expiredJobs() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return expired;
+    }
+
+    const QueueLimits& getLimits() const { return limits; }
+
+private:
+    struct Entry {
+        Prepared prepared;
+        TimerWheel::Id timer = 0;
+    };
+
+    TimerService& timers;
+    JobTracker& tracker;
+    QueueLimits limits;
+
+    mutable std::mutex mtx;
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t heldBytes = 0;
+    uint64_t expired = 0;
+};
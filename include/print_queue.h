@@ -0,0 +1,942 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Cola de impresión por impresora con control de admisión
+// ============================================================================
+//
+// Cada impresora lógica tiene su cola y un hilo que la drena hacia su
+// ESCPOSPrinter, así los pedidos HTTP nunca comparten el handle de la
+// impresora. Antes de encolar se verifican los límites de la impresora
+// (429) y del agente (503); el Retry-After sale de la velocidad de vaciado
+// medida (EWMA de bytes/s y trabajos/s).
+//
+// Dentro de cada cola hay tres carriles (urgent, normal, bulk). Los trabajos
+// masivos se escriben en tramos y, entre copias, ceden la impresora a los
+// urgentes y normales que hayan llegado.
+//
+// Cada carril reparte la impresora entre los clientes que la comparten
+// (FairLane, Deficit Round Robin con pesos por cliente): un POS que inunda
+// de etiquetas no demora los tickets de los demás más que su parte. Con
+// clients.max_share < 1 además ningún cliente ocupa más que esa fracción de
+// la cola y el que se pasa recibe 429 solo.
+//
+// Los trabajos en cola se pueden cancelar o pasar al frente en O(1): cada
+// carril tiene un índice por id que apunta a su nodo. Un masivo que ya
+// se está imprimiendo se corta en el próximo límite entre copias (se manda
+// el tramo final, con el corte de papel).
+//
+// Cada llamada al spooler tiene un plazo (write_timeout_ms) vigilado por la
+// rueda de temporizadores. Si vence, el watchdog cancela el documento,
+// cierra el handle, reencola la tanda en curso y levanta otro hilo con una
+// conexión nueva: el hilo colgado queda abandonado y no toca más la cola.
+
+#pragma once
+
+#include "alloc_tracker.h"
+#include "chunk_stream.h"
+#include "circuit_breaker.h"
+#include "config.h"
+#include "escpos_printer.h"
+#include "fair_lane.h"
+#include "job_tracker.h"
+#include "latency_histogram.h"
+#include "logger.h"
+#include "sim_printer.h"
+#include "timer_wheel.h"
+#include "tracer.h"
+#include "usdt.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tramo de un trabajo: un buffer compartido que se escribe `repeat` veces.
+// Las copias de etiquetas son un único tramo repetido, no N buffers.
+struct Segment {
+    std::shared_ptr<const std::vector<BYTE>> bytes;
+    int repeat = 1;
+
+    size_t printSize() const { return bytes->size() * (size_t)std::max(repeat, 0); }
+};
+
+// Carriles de prioridad: los urgentes y normales interrumpen a los masivos
+enum class Priority { Urgent = 0, Normal = 1, Bulk = 2 };
+const int PRIORITY_COUNT = 3;
+
+inline const char* priorityName(Priority p) {
+    switch (p) {
+        case Priority::Urgent: return "urgent";
+        case Priority::Normal: return "normal";
+        default:               return "bulk";
+    }
+}
+
+inline bool parsePriority(const std::string& s, Priority& out) {
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (s == priorityName((Priority)i)) {
+            out = (Priority)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct PrintJob {
+    uint64_t id = 0;
+    Priority priority = Priority::Normal;
+    std::vector<Segment> segments;
+    std::shared_ptr<ChunkStream> stream;    // streaming: los bytes llegan por bloques
+    std::string client;                     // X-Client-Id o IP de origen (reparto justo)
+    std::string ticket;                     // ticket_id del POS (historial de reimpresión)
+    std::chrono::steady_clock::time_point enqueuedAt;
+    uint64_t enqueuedTicks = 0;             // Tracer::ticks(), para la espera en el trace
+    // Última tanda que lo intentó imprimir (Server-Timing); se escriben
+    // antes de cumplir `done`
+    std::chrono::steady_clock::time_point printStartedAt;
+    std::chrono::steady_clock::time_point printedAt;
+    std::promise<bool> done;
+    int failovers = 0;                      // veces que pasó a una impresora de respaldo
+    int requeues  = 0;                      // veces que el watchdog lo reencoló
+    std::atomic<bool> cancelled{false};     // DELETE mientras se imprimía
+
+    // Bytes que el trabajo retiene mientras está en cola
+    size_t queuedSize() const {
+        if (stream) return stream->capacityBytes();
+        size_t total = 0;
+        for (auto& seg : segments) total += seg.printSize();
+        return total;
+    }
+};
+
+using PrintJobPtr = std::shared_ptr<PrintJob>;
+
+// Resultado del control de admisión
+struct Admission {
+    int status     = 200;   // 200 aceptado, 429 impresora llena, 503 agente lleno,
+                            // 413 no entra nunca (más grande que los topes)
+    int retryAfter = 0;     // segundos sugeridos al POS
+    bool accepted() const { return status == 200; }
+    bool tooLarge() const { return status == 413; }
+};
+
+// Velocidad de vaciado medida de una cola
+struct DrainRate {
+    double bytesPerSec = 20000.0;   // valores iniciales de una térmica típica
+    double jobsPerSec  = 5.0;
+
+    void sample(size_t bytes, double seconds, size_t jobs = 1) {
+        const double alpha = 0.2;
+        seconds = std::max(seconds, 0.001);
+        bytesPerSec += alpha * (bytes / seconds - bytesPerSec);
+        jobsPerSec  += alpha * (jobs / seconds - jobsPerSec);
+    }
+
+    // Segundos estimados hasta vaciar `jobs`/`bytes`
+    double drainSeconds(size_t jobs, size_t bytes) const {
+        return std::max(jobs / std::max(jobsPerSec, 0.01),
+                        bytes / std::max(bytesPerSec, 1.0));
+    }
+
+    int retryAfter(size_t jobs, size_t bytes) const {
+        return std::clamp((int)std::ceil(drainSeconds(jobs, bytes)), 1, 300);
+    }
+};
+
+// Presupuesto global del agente, compartido por todas las colas
+class GlobalBudget {
+public:
+    explicit GlobalBudget(const QueueLimits& l) : limits(l) {}
+
+    bool reserve(size_t bytes) {
+        size_t j = jobs.fetch_add(1) + 1;
+        size_t b = queuedBytes.fetch_add(bytes) + bytes;
+        if (j > limits.maxJobs || b > limits.maxBytes) {
+            release(bytes);
+            return false;
+        }
+        return true;
+    }
+
+    void release(size_t bytes) {
+        jobs.fetch_sub(1);
+        queuedBytes.fetch_sub(bytes);
+    }
+
+    size_t queuedJobs() const { return jobs.load(); }
+    size_t bytes() const { return queuedBytes.load(); }
+    const QueueLimits& getLimits() const { return limits; }
+
+private:
+    QueueLimits limits;
+    std::atomic<size_t> jobs{0};
+    std::atomic<size_t> queuedBytes{0};
+};
+
+class PrintQueue {
+public:
+    // Profundidad de cola por cliente
+    struct ClientStats {
+        size_t queuedJobs  = 0;
+        size_t queuedBytes = 0;
+        uint64_t completed = 0;
+        uint64_t rejected  = 0;
+    };
+
+    struct Stats {
+        std::string device;
+        bool   online      = false;
+        size_t queuedJobs  = 0;
+        size_t queuedBytes = 0;
+        uint64_t completed = 0;
+        uint64_t failed    = 0;
+        uint64_t rejected  = 0;
+        uint64_t preemptions = 0;
+        uint64_t batches   = 0;     // documentos con más de un trabajo
+        uint64_t coalesced = 0;     // trabajos enviados dentro de esas tandas
+        int64_t  coalesceWindowUs = 0;
+        uint64_t failovers = 0;     // trabajos derivados a la impresora de respaldo
+        uint64_t watchdogResets = 0;    // conexiones colgadas recicladas
+        uint64_t cancelled = 0;
+        uint64_t abortedUploads = 0;    // streamings cortados por el cliente
+        DrainRate rate;
+        LatencyHistogram wait[PRIORITY_COUNT];   // espera en cola por prioridad
+        std::map<std::string, ClientStats> clients;
+    };
+
+    PrintQueue(std::string name, const PrinterConfig& cfg, GlobalBudget& budget,
+               const ClientPolicy& clients, TimerService& timers, JobTracker& tracker)
+        : name(std::move(name)), config(cfg), budget(budget), clients(clients), timers(timers),
+          tracker(tracker),
+          breaker(breakerSettings(this->name, cfg)), worker(std::make_shared<Worker>(*this)) {}
+
+    ~PrintQueue() { stop(); }
+
+    // Abre la impresora antes de arrancar el hilo (para el banner)
+    bool open() {
+        std::shared_ptr<Worker> w;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            w = worker;
+        }
+        bool ok = w->printer.open(config.device);
+        std::lock_guard<std::mutex> lock(mtx);
+        setOnline(ok);
+        stats.device = w->printer.getPrinterName();
+        return ok;
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mtx);
+        launch(worker);
+    }
+
+    void stop() {
+        std::shared_ptr<Worker> w;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            w = worker;
+        }
+        cv.notify_all();
+        if (w->thread.joinable()) w->thread.join();
+    }
+
+    Admission submit(const PrintJobPtr& job) {
+        const size_t size = job->queuedSize();
+        std::lock_guard<std::mutex> lock(mtx);
+
+        // No entraría ni con la cola vacía: no se sugiere reintentar
+        if (size > maxJobBytes()) {
+            stats.rejected++;
+            return {413, 0};
+        }
+
+        if (stats.queuedJobs + 1 > config.limits.maxJobs ||
+            stats.queuedBytes + size > config.limits.maxBytes)
+        {
+            stats.rejected++;
+            return {429, stats.rate.retryAfter(stats.queuedJobs, stats.queuedBytes)};
+        }
+
+        // Tope por cliente: lo que le queda libre a la cola es para los demás
+        ClientStats& cs = stats.clients[job->client];
+        if (cs.queuedJobs + 1 > std::max<size_t>(1, (size_t)(config.limits.maxJobs * clients.maxShare)) ||
+            cs.queuedBytes + size > (size_t)(config.limits.maxBytes * clients.maxShare))
+        {
+            cs.rejected++;
+            stats.rejected++;
+            return {429, stats.rate.retryAfter(cs.queuedJobs, cs.queuedBytes)};
+        }
+
+        if (!budget.reserve(size)) {
+            stats.rejected++;
+            return {503, 0};
+        }
+
+        job->enqueuedAt = std::chrono::steady_clock::now();
+        job->enqueuedTicks = Tracer::ticks();
+        stats.queuedJobs++;
+        stats.queuedBytes += size;
+        cs.queuedJobs++;
+        cs.queuedBytes += size;
+        enqueue(job, false);
+        HIVA_PROBE(job_enqueue, job->id, name.c_str(), size, priorityName(job->priority));
+        tracker.publish(job->id, JobState::Queued, name);
+        cv.notify_one();
+        return {};
+    }
+
+    enum class CancelResult {
+        Cancelled,  // estaba en cola: no se imprime
+        Stopping,   // masivo o streaming en curso: se corta en el próximo límite
+        TooLate,    // ya se está escribiendo y no se puede cortar
+        NotFound,
+    };
+
+    CancelResult cancel(uint64_t id) {
+        PrintJobPtr job;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            job = dequeue(id);
+            if (!job) {
+                for (auto& j : worker->inFlight) {
+                    if (j->id != id) continue;
+                    if (!j->stream && j->priority != Priority::Bulk) return CancelResult::TooLate;
+                    j->cancelled = true;
+                    if (j->stream) j->stream->abort();
+                    return CancelResult::Stopping;
+                }
+                return CancelResult::NotFound;
+            }
+
+            untrack(*job);
+            stats.cancelled++;
+        }
+
+        budget.release(job->queuedSize());
+        if (job->stream) job->stream->abort();
+        tracker.publish(job->id, JobState::Cancelled, name);
+        job->done.set_value(false);
+        return CancelResult::Cancelled;
+    }
+
+    // Pasa un trabajo en cola al frente: queda primero en el carril urgente
+    bool moveToFront(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        PrintJobPtr job = dequeue(id);
+        if (!job) return false;
+
+        job->priority = Priority::Urgent;
+        enqueue(job, true);
+        cv.notify_one();
+        return true;
+    }
+
+    Stats snapshot() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stats;
+    }
+
+    DrainRate drainRate() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stats.rate;
+    }
+
+    // Tiempo estimado para vaciar lo encolado (para repartir en un pool)
+    double estimatedDrainSec() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stats.rate.drainSeconds(stats.queuedJobs, stats.queuedBytes);
+    }
+
+    // Sana mientras el breaker no esté abierto
+    bool healthy() const { return !breaker.isOpen(); }
+
+    // Se llama con cada trabajo impreso (historial)
+    using PrintedHook = std::function<void(const PrintJobPtr&, const std::string& printer)>;
+    void setPrintedHook(PrintedHook hook) { printedHook = std::move(hook); }
+
+    void setFallback(PrintQueue* q) { fallback = q; }
+    PrintQueue* getFallback() const { return fallback; }
+    const CircuitBreaker& getBreaker() const { return breaker; }
+
+    const QueueLimits& getLimits() const { return config.limits; }
+    const std::string& getName() const { return name; }
+
+    // Trabajo más grande que se puede admitir: la parte de un cliente de la
+    // cola, sin pasar el tope de todo el agente
+    size_t maxJobBytes() const {
+        return std::min((size_t)(config.limits.maxBytes * clients.maxShare), budget.getLimits().maxBytes);
+    }
+
+private:
+    // Saltos máximos de respaldo por trabajo (evita ciclos A -> B -> A)
+    static constexpr int MAX_FAILOVERS = 2;
+    // Reencolados por el watchdog antes de dar el trabajo por fallido
+    static constexpr int MAX_REQUEUES = 2;
+
+    // Paso máximo entre puntos de corte de un trabajo masivo
+    static constexpr size_t BULK_STEP_BYTES = 64 * 1024;
+    // Tope de bytes de una tanda agrupada
+    static constexpr size_t COALESCE_MAX_BYTES = 64 * 1024;
+
+    std::string name;
+    PrinterConfig config;
+    GlobalBudget& budget;
+    const ClientPolicy& clients;
+    TimerService& timers;
+    JobTracker& tracker;
+    CircuitBreaker breaker;
+    PrintQueue* fallback = nullptr;
+    PrintedHook printedHook;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    FairLane<PrintJobPtr> lanes[PRIORITY_COUNT];
+    std::atomic<int> preemptors{0};     // urgentes + normales en cola
+    Stats stats;
+    int64_t windowUs = 0;               // ventana de agrupamiento actual
+    bool stopping = false;
+
+    // Hilo de impresión con su propia conexión a la impresora. Se guarda en
+    // un shared_ptr: si el watchdog lo abandona, el hilo colgado conserva su
+    // Worker hasta que la llamada vuelva.
+    struct Worker : WriteWatch, std::enable_shared_from_this<Worker> {
+        PrintQueue& queue;
+        ESCPOSPrinter printer;
+        std::thread thread;
+        std::atomic<bool> abandoned{false};
+        std::vector<PrintJobPtr> inFlight;      // con mtx de la cola
+
+        // Llamada en curso al backend. Con callMtx: onStuck decide el
+        // abandono sólo si la llamada sigue en vuelo, y una que ya volvió
+        // (disarmed) no se puede abandonar después
+        std::mutex callMtx;
+        uint64_t calls = 0;
+        bool inCall = false;
+        TimerWheel::Id deadline = 0;            // sólo el hilo del worker
+
+        explicit Worker(PrintQueue& q) : queue(q), printer(backendFor(q.config)) { printer.setWatch(this); }
+
+        void armed() override {
+            uint64_t call;
+            {
+                std::lock_guard<std::mutex> lock(callMtx);
+                call = ++calls;
+                inCall = true;
+            }
+            arm(call);
+        }
+
+        // El equipo aceptó bytes: el plazo vuelve a correr desde ahora. Una
+        // impresora lenta pero que avanza no es una impresora colgada.
+        void progress() override {
+            uint64_t call;
+            {
+                std::lock_guard<std::mutex> lock(callMtx);
+                if (!inCall) return;
+                call = ++calls;
+            }
+            queue.timers.cancel(deadline);
+            arm(call);
+        }
+
+        void disarmed() override {
+            {
+                std::lock_guard<std::mutex> lock(callMtx);
+                inCall = false;
+            }
+            queue.timers.cancel(deadline);
+        }
+
+        // Fuera de callMtx: el callback del timer la toma
+        void arm(uint64_t call) {
+            std::weak_ptr<Worker> self = weak_from_this();
+            deadline = queue.timers.after(std::chrono::milliseconds(queue.config.writeTimeoutMs),
+                [self, call] {
+                    if (auto w = self.lock()) w->queue.onStuck(w, call);
+                });
+        }
+    };
+    std::shared_ptr<Worker> worker;     // el vigente (con mtx)
+
+    // Con mtx tomado
+    void launch(const std::shared_ptr<Worker>& w) {
+        w->thread = std::thread([this, w] { run(*w); });
+    }
+
+    // Watchdog (hilo de la rueda): la llamada `call` de `w` superó su plazo
+    void onStuck(const std::shared_ptr<Worker>& w, uint64_t call) {
+        std::vector<PrintJobPtr> failed;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stopping || w != worker) return;
+            {
+                std::lock_guard<std::mutex> callLock(w->callMtx);
+                if (!w->inCall || w->calls != call) return;
+                w->abandoned = true;
+            }
+            stats.watchdogResets++;
+
+            // Al frente de su carril, en el orden original. Un streaming ya
+            // consumido no se puede repetir.
+            for (auto it = w->inFlight.rbegin(); it != w->inFlight.rend(); ++it) {
+                PrintJobPtr job = *it;
+                if (job->stream || job->cancelled || ++job->requeues > MAX_REQUEUES) {
+                    failed.push_back(job);
+                    untrack(*job);
+                    if (job->cancelled) stats.cancelled++;
+                    else                stats.failed++;
+                    continue;
+                }
+                enqueue(job, true);
+                tracker.publish(job->id, JobState::Queued, name);
+            }
+            w->inFlight.clear();
+            setOnline(false);
+
+            worker = std::make_shared<Worker>(*this);
+            launch(worker);
+        }
+        cv.notify_all();
+
+        LOG_WARN("Impresora {} sin respuesta; se recicla la conexion", name);
+        breaker.recordFailure();
+        w->printer.abort();
+        if (w->thread.joinable()) w->thread.detach();
+
+        for (auto& job : failed) {
+            budget.release(job->queuedSize());
+            if (job->stream) job->stream->abort();
+            tracker.publish(job->id, job->cancelled ? JobState::Cancelled : JobState::Failed, name);
+            job->done.set_value(false);
+        }
+    }
+
+    // Con mtx tomado
+    void enqueue(const PrintJobPtr& job, bool front) {
+        lanes[(int)job->priority].push(job, clients.weightOf(job->client), front);
+        if (job->priority != Priority::Bulk) preemptors++;
+    }
+
+    // Saca un trabajo en cola por id; nullptr si no está (con mtx tomado)
+    PrintJobPtr dequeue(uint64_t id) {
+        for (auto& lane : lanes) {
+            if (PrintJobPtr job = lane.remove(id)) {
+                if (job->priority != Priority::Bulk) preemptors--;
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    // Saca el trabajo de mayor prioridad hasta `lowest`; dentro del carril,
+    // el del cliente al que le toca el turno (con mtx tomado)
+    PrintJobPtr popNext(Priority lowest) {
+        for (int l = 0; l <= (int)lowest; l++) {
+            PrintJobPtr job = lanes[l].pop();
+            if (!job) continue;
+            if (job->priority != Priority::Bulk) preemptors--;
+            return job;
+        }
+        return nullptr;
+    }
+
+    // Tope de clientes sin trabajos que se conservan en las métricas
+    static constexpr size_t MAX_IDLE_CLIENTS = 256;
+
+    // Descuenta de la cola un trabajo que terminó o salió (con mtx tomado)
+    void untrack(const PrintJob& job) {
+        const size_t size = job.queuedSize();
+        stats.queuedJobs--;
+        stats.queuedBytes -= size;
+
+        auto it = stats.clients.find(job.client);
+        if (it == stats.clients.end()) return;
+        it->second.queuedJobs--;
+        it->second.queuedBytes -= size;
+        if (it->second.queuedJobs == 0 && stats.clients.size() > MAX_IDLE_CLIENTS)
+            stats.clients.erase(it);
+    }
+
+    // Cada Worker abre su propio backend: uno abandonado por el watchdog se
+    // queda con el suyo
+    static std::unique_ptr<PrinterBackend> backendFor(const PrinterConfig& cfg) {
+        if (cfg.backend == "sim") return std::make_unique<SimulatedBackend>(cfg.sim);
+#ifdef _WIN32
+        if (cfg.backend == "spooler") return std::make_unique<SpoolerBackend>();
+#endif
+        if (cfg.backend != "null")
+            LOG_WARN("Backend {} no disponible, se usa null", cfg.backend);
+        return std::make_unique<NullBackend>();
+    }
+
+    // Con mtx tomado
+    void setOnline(bool online) {
+        if (online != stats.online) HIVA_PROBE(printer_state, name.c_str(), (int)online);
+        stats.online = online;
+    }
+
+    static size_t batchBytes(const std::vector<PrintJobPtr>& batch) {
+        size_t total = 0;
+        for (auto& job : batch) total += job->queuedSize();
+        return total;
+    }
+
+    static CircuitBreaker::Settings breakerSettings(const std::string& name, const PrinterConfig& cfg) {
+        CircuitBreaker::Settings s;
+        s.name        = name;
+        s.failureRate = cfg.breakerFailureRate;
+        s.cooldown    = std::chrono::milliseconds(cfg.breakerCooldownMs);
+        return s;
+    }
+
+    void run(Worker& w) {
+        Tracer::nameThread("printer:" + name);
+        AllocTracker::setStage(AllocStageId::Print);
+        for (;;) {
+            std::vector<PrintJobPtr> batch;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || stats.queuedJobs > 0; });
+                if (w.abandoned) return;
+                PrintJobPtr job = popNext(Priority::Bulk);
+                if (!job) return;
+                batch.push_back(job);
+                if (coalescible(*job)) collectBatch(lock, batch);
+                w.inFlight.insert(w.inFlight.end(), batch.begin(), batch.end());
+            }
+
+            // Con el breaker abierto lo encolado pasa al respaldo sin esperar
+            // otro timeout del equipo caído; vencido el cooldown, esta tanda es la prueba
+            if (!breaker.allowRequest() && fallback) {
+                finish(w, batch, Sent::Failed, 0, 0.0, true);
+                continue;
+            }
+            process(w, batch);
+            if (w.abandoned) return;
+        }
+    }
+
+    static bool coalescible(const PrintJob& job) {
+        return !job.stream && job.priority != Priority::Bulk;
+    }
+
+    // Siguiente urgente/normal que se pueda sumar a la tanda (con mtx tomado)
+    PrintJobPtr popCoalescible() {
+        for (int l = 0; l <= (int)Priority::Normal; l++) {
+            PrintJobPtr next = lanes[l].peek();
+            if (!next) continue;
+            if (!coalescible(*next)) return nullptr;
+            return popNext(Priority::Normal);
+        }
+        return nullptr;
+    }
+
+    // Ventana de agrupamiento estilo Nagle: junta los trabajos chicos que
+    // llegan en pocos milisegundos para mandarlos en un solo documento. La
+    // ventana crece mientras haya carga y se achica hasta 0 con la cola
+    // ociosa, así un ticket aislado no espera nada.
+    void collectBatch(std::unique_lock<std::mutex>& lock, std::vector<PrintJobPtr>& batch) {
+        const bool backlog = preemptors.load() > 0;
+        size_t bytes = batch.front()->queuedSize();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(windowUs);
+
+        for (bool waited = false;; waited = true) {
+            const size_t before = batch.size();
+            while (bytes < COALESCE_MAX_BYTES) {
+                PrintJobPtr next = popCoalescible();
+                if (!next) break;
+                bytes += next->queuedSize();
+                batch.push_back(next);
+            }
+            // Lo que llegó no se puede agrupar (p. ej. un streaming urgente)
+            if (waited && batch.size() == before) break;
+            if (windowUs == 0 || bytes >= COALESCE_MAX_BYTES || stopping) break;
+
+            bool arrived = cv.wait_until(lock, deadline, [this] {
+                return stopping || preemptors.load() > 0;
+            });
+            if (!arrived) break;
+        }
+
+        if (backlog || batch.size() > 1)
+            windowUs = std::min<int64_t>(windowUs ? windowUs * 2 : 250, config.coalesceMaxUs);
+        else
+            windowUs = windowUs >= 200 ? windowUs / 2 : 0;
+
+        stats.coalesceWindowUs = windowUs;
+        if (batch.size() > 1) {
+            stats.batches++;
+            stats.coalesced += batch.size();
+        }
+    }
+
+    // Cómo terminó el envío de una tanda
+    enum class Sent { Ok, Failed, SourceAborted };
+
+    void process(Worker& w, const std::vector<PrintJobPtr>& batch) {
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& job : batch) {
+                stats.wait[(int)job->priority].record(
+                    std::chrono::duration_cast<std::chrono::microseconds>(t0 - job->enqueuedAt).count());
+            }
+        }
+        for (auto& job : batch) tracker.publish(job->id, JobState::Sent, name);
+
+        if (Tracer::on()) {
+            const uint64_t now = Tracer::ticks();
+            for (auto& job : batch) Tracer::record({"queued", "queue", job->enqueuedTicks, now, job->id, true});
+        }
+        TraceSpan span("printer", batch.size() == 1 ? "print" : "print batch", batch.front()->id);
+
+        size_t written = 0, sentJobs = 0;
+        HIVA_PROBE(write_start, batch.front()->id, name.c_str(), batchBytes(batch), batch.size());
+        Sent sent = !w.printer.open(config.device)          ? Sent::Failed
+                  : batch.size() == 1                       ? print(w, *batch.front(), written)
+                  : printBatch(w, batch, written, sentJobs) ? Sent::Ok : Sent::Failed;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+        HIVA_PROBE(write_end, batch.front()->id, name.c_str(), written, (int)(sent == Sent::Ok));
+
+        // Abandonado por el watchdog: la tanda ya se reencoló y la falla se contó
+        if (w.abandoned) return;
+
+        // Una subida cortada por el cliente no dice nada de la impresora
+        if (sent == Sent::Ok)          breaker.recordSuccess();
+        else if (sent == Sent::Failed) breaker.recordFailure();
+
+        // Tras una falla se reabre el handle en el próximo intento
+        if (sent == Sent::Failed) w.printer.close();
+
+        // Tanda cortada a mitad: los trabajos que ya se escribieron enteros
+        // salieron por la impresora; sólo fallan (o pasan al respaldo) los demás
+        if (sent == Sent::Failed && sentJobs > 0) {
+            std::vector<PrintJobPtr> printed(batch.begin(), batch.begin() + sentJobs);
+            std::vector<PrintJobPtr> rest(batch.begin() + sentJobs, batch.end());
+            finish(w, printed, Sent::Ok, 0, elapsed.count(), false);
+            finish(w, rest, Sent::Failed, 0, elapsed.count(), false);
+            return;
+        }
+        finish(w, batch, sent, written, elapsed.count(), false);
+    }
+
+    // Cierra la contabilidad de una tanda. Los trabajos fallidos (o desviados
+    // con el breaker abierto) se pasan a la impresora de respaldo si hay.
+    void finish(Worker& w, const std::vector<PrintJobPtr>& batch, Sent sent, size_t written,
+                double seconds, bool diverted)
+    {
+        const PrintJob& first = *batch.front();
+        const bool ok = sent == Sent::Ok;
+        const auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (w.abandoned) return;
+            for (auto& job : batch) {
+                w.inFlight.erase(std::find(w.inFlight.begin(), w.inFlight.end(), job));
+                job->printedAt = now;
+                job->printStartedAt = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(seconds));
+            }
+            for (auto& job : batch) {
+                if (ok && !job->cancelled) {
+                    auto it = stats.clients.find(job->client);
+                    if (it != stats.clients.end()) it->second.completed++;
+                }
+                untrack(*job);
+            }
+            setOnline(w.printer.getIsOpen());
+            stats.device = w.printer.getPrinterName();
+            if (first.cancelled) {
+                stats.cancelled++;      // sólo masivos y streamings: tanda de uno
+            } else if (ok) {
+                stats.completed += batch.size();
+                // En streaming el tiempo incluye la subida, y un masivo
+                // interrumpido incluye a otros trabajos: no sirven como muestra.
+                // Tampoco lo que salió de una tanda que falló (sin bytes medidos).
+                if (!first.stream && first.priority != Priority::Bulk && written > 0)
+                    stats.rate.sample(written, seconds, batch.size());
+            } else if (sent == Sent::SourceAborted) {
+                stats.abortedUploads++;
+            } else if (!diverted) {
+                stats.failed += batch.size();
+            }
+        }
+
+        for (auto& job : batch) {
+            budget.release(job->queuedSize());
+            if (job->cancelled) {
+                LOG_DEBUG("Trabajo {} cancelado en {}", job->id, name);
+                tracker.publish(job->id, JobState::Cancelled, name);
+                job->done.set_value(false);
+            } else if (ok) {
+                LOG_DEBUG("Trabajo {} impreso en {} ({} bytes, cliente {})", job->id, name,
+                          job->queuedSize(), job->client);
+                tracker.publish(job->id, JobState::Printed, name);
+                if (printedHook) printedHook(job, name);
+                job->done.set_value(true);
+            } else if (sent == Sent::SourceAborted) {
+                LOG_DEBUG("Trabajo {} en {}: el cliente corto la subida", job->id, name);
+                tracker.publish(job->id, JobState::Failed, name);
+                job->done.set_value(false);
+            } else if (!failover(job, diverted)) {
+                LOG_WARN("Trabajo {} fallo en {}", job->id, name);
+                if (job->stream) job->stream->abort();
+                tracker.publish(job->id, JobState::Failed, name);
+                job->done.set_value(false);
+            } else {
+                LOG_DEBUG("Trabajo {} pasa de {} a su respaldo", job->id, name);
+            }
+        }
+    }
+
+    // Un streaming ya empezado no se puede repetir: sólo se desvía sin tocar
+    bool failover(const PrintJobPtr& job, bool untouched) {
+        if (!fallback || job->failovers >= MAX_FAILOVERS) return false;
+        if (job->stream && !untouched) return false;
+
+        job->failovers++;
+        if (!fallback->submit(job).accepted()) return false;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        stats.failovers++;
+        return true;
+    }
+
+    // Imprime los urgentes y normales que llegaron durante un trabajo masivo
+    void servePreemptors(Worker& w) {
+        for (;;) {
+            std::vector<PrintJobPtr> batch;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (w.abandoned) return;
+                PrintJobPtr job = popNext(Priority::Normal);
+                if (!job) return;
+                batch.push_back(job);
+                if (coalescible(*job)) {
+                    while (PrintJobPtr next = popCoalescible()) batch.push_back(next);
+                }
+                stats.preemptions += batch.size();
+                w.inFlight.insert(w.inFlight.end(), batch.begin(), batch.end());
+            }
+            process(w, batch);
+        }
+    }
+
+    // Varios trabajos chicos en un único documento. `sentJobs`: cuántos se
+    // escribieron enteros (si falla, los primeros `sentJobs` ya salieron)
+    bool printBatch(Worker& w, const std::vector<PrintJobPtr>& batch, size_t& written, size_t& sentJobs) {
+        ESCPOSPrinter& printer = w.printer;
+        if (!printer.beginDoc()) return false;
+
+        for (auto& job : batch) {
+            for (auto& seg : job->segments) {
+                if (!writeSegment(printer, seg, seg.repeat)) {
+                    printer.endDoc();
+                    return false;
+                }
+                written += seg.printSize();
+            }
+            sentJobs++;
+        }
+
+        printer.endDoc();
+        return true;
+    }
+
+    Sent print(Worker& w, PrintJob& job, size_t& written) {
+        if (!w.printer.beginDoc()) return Sent::Failed;
+        if (job.stream) return printStream(w, job, written);
+        return printEncoded(w, job, written) ? Sent::Ok : Sent::Failed;
+    }
+
+    // Streaming: escribir cada bloque apenas lo produce el pedido HTTP. No
+    // cede la impresora: está atado a una subida en curso. Un DELETE aborta
+    // el canal y corta acá (cancelado); si lo abortó el pedido HTTP, el
+    // cliente se fue a mitad de la subida y la impresora no tuvo la culpa.
+    Sent printStream(Worker& w, PrintJob& job, size_t& written) {
+        ESCPOSPrinter& printer = w.printer;
+        bool ok = true;
+        ChunkStream::Chunk chunk;
+        while (ok && job.stream->pop(chunk)) {
+            ok = printer.write(chunk.data(), chunk.size());
+            written += chunk.size();
+        }
+        printer.endDoc();
+        if (!ok) return Sent::Failed;
+        return job.stream->isAborted() && !job.cancelled ? Sent::SourceAborted : Sent::Ok;
+    }
+
+    // Con el documento ya abierto
+    bool printEncoded(Worker& w, PrintJob& job, size_t& written) {
+        ESCPOSPrinter& printer = w.printer;
+
+        // Los trabajos masivos se cortan entre copias/tramos para dejar pasar
+        // a los urgentes; al retomar se reenvía el encabezado (primer tramo)
+        const bool preemptible = job.priority == Priority::Bulk;
+
+        for (size_t i = 0; i < job.segments.size(); i++) {
+            const Segment& seg = job.segments[i];
+            const size_t segSize = std::max<size_t>(seg.bytes->size(), 1);
+            const int step = preemptible
+                ? (int)std::max<size_t>(1, BULK_STEP_BYTES / segSize)
+                : std::max(seg.repeat, 1);
+
+            for (int done = 0; done < seg.repeat; done += step) {
+                if (job.cancelled) return stopAtBoundary(printer, job);
+
+                if (preemptible && preemptors.load() > 0 && (i > 0 || done > 0)) {
+                    printer.endDoc();
+                    servePreemptors(w);
+                    if (!printer.beginDoc()) return false;
+                    if (i > 0 && !writeSegment(printer, job.segments[0], 1)) {
+                        printer.endDoc();
+                        return false;
+                    }
+                }
+
+                int n = std::min(step, seg.repeat - done);
+                if (!writeSegment(printer, seg, n)) {
+                    printer.endDoc();
+                    return false;
+                }
+                written += seg.bytes->size() * n;
+            }
+        }
+
+        printer.endDoc();
+        return true;
+    }
+
+    // Cancelado a mitad de un masivo: se manda el tramo final (el corte de
+    // papel) para dejar la impresora en un estado limpio
+    bool stopAtBoundary(ESCPOSPrinter& printer, const PrintJob& job) {
+        bool ok = job.segments.size() < 2 || writeSegment(printer, job.segments.back(), 1);
+        printer.endDoc();
+        return ok;
+    }
+
+    // Las copias se resuelven con una macro de la impresora si entra en su
+    // buffer, o escribiendo el mismo buffer varias veces
+    bool writeSegment(ESCPOSPrinter& printer, const Segment& seg, int times) {
+        const std::vector<BYTE>& b = *seg.bytes;
+        if (times <= 0) return true;
+        if (times == 1) return printer.write(b.data(), b.size());
+
+        if (config.macros && b.size() <= config.macroMax) {
+            std::vector<BYTE> macro;
+            ESCPOSPrinter::appendMacro(macro, b.data(), b.size(), times);
+            return printer.write(macro.data(), macro.size());
+        }
+        return printer.writeRepeated(b.data(), b.size(), times);
+    }
+};
@@ -0,0 +1,65 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// PrinterBackend - Destino de los bytes ESC/POS de una impresora
+// ============================================================================
+//
+// ESCPOSPrinter habla ESC/POS y delega el transporte en un backend:
+//   "spooler"  la cola de impresión de Windows (winspool), el de siempre
+//   "null"     descarta todo al instante: mide al agente sin impresora
+//   "sim"      impresora simulada (velocidad, buffer, fallas; sim_printer.h)
+//
+// Mismo contrato que winspool: open, documento (beginDoc/write/endDoc),
+// close. abort() se llama desde otro hilo con una llamada colgada y tiene
+// que hacerla volver; después la instancia sólo falla. Una escritura larga
+// avisa con advanced() cada tramo que el equipo acepta, para que el watchdog
+// no tome por colgada a una impresora lenta.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class PrinterBackend {
+public:
+    virtual ~PrinterBackend() = default;
+
+    // `name` ya resuelto (no vacío); false si no se pudo abrir
+    virtual bool open(const std::string& name) = 0;
+    virtual void close() = 0;
+    virtual void abort() = 0;
+
+    virtual bool beginDoc() = 0;
+    virtual bool write(const uint8_t* data, size_t size) = 0;
+    virtual void endDoc() = 0;
+
+    // Equipo a usar si la configuración no nombra uno ("" = no hay)
+    virtual std::string defaultDevice() = 0;
+
+    // Código del último error (GetLastError en el spooler), para el log
+    virtual unsigned long lastError() const { return 0; }
+
+    void setProgress(std::function<void()> f) { progress = std::move(f); }
+
+protected:
+    // Desde el hilo que escribe, sin locks del backend tomados
+    void advanced() {
+        if (progress) progress();
+    }
+
+private:
+    std::function<void()> progress;
+};
+
+class NullBackend : public PrinterBackend {
+public:
+    bool open(const std::string&) override { return true; }
+    void close() override {}
+    void abort() override {}
+    bool beginDoc() override { return true; }
+    bool write(const uint8_t*, size_t) override { return true; }
+    void endDoc() override {}
+    std::string defaultDevice() override { return "null"; }
+};
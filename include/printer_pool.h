@@ -0,0 +1,92 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// PrinterPool - Impresora lógica repartida entre varias impresoras iguales
+// ============================================================================
+//
+// Cada trabajo va al miembro sano con menor tiempo estimado de vaciado
+// (bytes en cola / velocidad medida). Los trabajos de varias partes que
+// comparten un `group` (p. ej. el número de pedido) quedan en el mismo
+// equipo mientras éste siga sano.
+
+#pragma once
+
+#include "print_queue.h"
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PrinterPool {
+public:
+    explicit PrinterPool(std::vector<PrintQueue*> members) : members(std::move(members)) {}
+
+    PrintQueue* pick(const std::string& group) {
+        const auto now = std::chrono::steady_clock::now();
+
+        if (!group.empty()) {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = sticky.find(group);
+            if (it != sticky.end() && now - it->second.lastUsed < STICKY_TTL &&
+                it->second.queue->healthy())
+            {
+                it->second.lastUsed = now;
+                return it->second.queue;
+            }
+        }
+
+        PrintQueue* best = leastLoaded(true);
+        if (!best) best = leastLoaded(false);    // todos caídos: igual repartir
+
+        if (!group.empty()) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (sticky.size() >= MAX_STICKY) prune(now);
+            sticky[group] = {best, now};
+        }
+        return best;
+    }
+
+    const std::vector<PrintQueue*>& getMembers() const { return members; }
+
+    size_t stickyGroups() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return sticky.size();
+    }
+
+private:
+    static constexpr std::chrono::minutes STICKY_TTL{10};
+    static constexpr size_t MAX_STICKY = 4096;
+
+    struct Sticky {
+        PrintQueue* queue;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    std::vector<PrintQueue*> members;
+    mutable std::mutex mtx;
+    std::unordered_map<std::string, Sticky> sticky;
+
+    PrintQueue* leastLoaded(bool onlyHealthy) const {
+        PrintQueue* best = nullptr;
+        double bestSec = std::numeric_limits<double>::max();
+        for (PrintQueue* q : members) {
+            if (onlyHealthy && !q->healthy()) continue;
+            double sec = q->estimatedDrainSec();
+            if (sec < bestSec) {
+                bestSec = sec;
+                best = q;
+            }
+        }
+        return best;
+    }
+
+    // Descarta grupos vencidos (con mtx tomado)
+    void prune(std::chrono::steady_clock::time_point now) {
+        for (auto it = sticky.begin(); it != sticky.end();) {
+            if (now - it->second.lastUsed >= STICKY_TTL) it = sticky.erase(it);
+            else ++it;
+        }
+        if (sticky.size() >= MAX_STICKY) sticky.clear();
+    }
+};
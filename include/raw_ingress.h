@@ -0,0 +1,401 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// RawIngress - Servidor de impresión RAW (puerto 9100) para POS legacy
+// ============================================================================
+//
+// Algunos POS viejos sólo saben imprimir a una "impresora de red" en el
+// puerto 9100. Cada puerto configurado (raw_port) apunta a una impresora
+// lógica; el flujo ESC/POS recibido se corta en trabajos cuando:
+//   - llega un comando de corte (GS V, ESC i, ESC m) fuera de los datos de
+//     otro comando: los comandos se siguen con sus largos, así un logo
+//     raster o un código de barras con esos bytes no parte el trabajo,
+//   - la conexión queda inactiva raw_idle_ms,
+//   - o el cliente cierra la conexión.
+// Si el puerto apunta a un pool, cada conexión queda fija en un equipo.
+// Los bytes se reciben directamente en el buffer del trabajo, que se mueve
+// a la cola sin copiarse: se mira el socket (MSG_PEEK) y se consume sólo
+// hasta el corte, así lo que sigue queda para el buffer del próximo trabajo.
+// Si la cola está llena se deja de leer el socket y el control de flujo de
+// TCP frena al POS, como haría una impresora real. Un trabajo no crece más
+// de lo que la cola puede admitir: al llegar a ese tope se encola lo que hay
+// y lo que sigue va en otro trabajo.
+
+#pragma once
+
+#include "alloc_tracker.h"
+#include "httplib.h"
+#include "logger.h"
+#include "spooler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RawIngress {
+public:
+    RawIngress(Spooler& spooler, std::string printer, int port, int idleMs)
+        : spooler(spooler), printer(std::move(printer)), port(port), idleMs(idleMs) {}
+
+    ~RawIngress() { stop(); }
+
+    bool start() {
+        listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID_SOCKET) return false;
+
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port        = htons((unsigned short)port);
+
+        if (::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0)
+        {
+            LOG_ERROR("No se pudo abrir el puerto RAW {}", port);
+            closeSocket(listener);
+            listener = INVALID_SOCKET;
+            return false;
+        }
+
+        acceptThread = std::thread([this] { acceptLoop(); });
+        return true;
+    }
+
+    void stop() {
+        stopping = true;
+        if (acceptThread.joinable()) acceptThread.join();
+        if (listener != INVALID_SOCKET) {
+            closeSocket(listener);
+            listener = INVALID_SOCKET;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& c : connections)
+            if (c.thread.joinable()) c.thread.join();
+        connections.clear();
+    }
+
+    int getPort() const { return port; }
+    const std::string& getPrinter() const { return printer; }
+
+private:
+    static constexpr size_t CHUNK = 16 * 1024;
+
+    Spooler& spooler;
+    std::string printer;
+    int port;
+    int idleMs;
+
+    socket_t listener = INVALID_SOCKET;
+    std::atomic<bool> stopping{false};
+    std::thread acceptThread;
+    std::mutex mtx;
+    uint64_t accepted = 0;
+
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+    std::list<Connection> connections;
+
+    static void closeSocket(socket_t s) {
+#ifdef _WIN32
+        closesocket(s);
+#else
+        ::close(s);
+#endif
+    }
+
+    // > 0 si hay datos para leer, 0 si venció el timeout
+    static int waitReadable(socket_t s, int timeoutMs) {
+#ifdef _WIN32
+        WSAPOLLFD pfd{s, POLLIN, 0};
+        return WSAPoll(&pfd, 1, timeoutMs);
+#else
+        pollfd pfd{s, POLLIN, 0};
+        return ::poll(&pfd, 1, timeoutMs);
+#endif
+    }
+
+    void acceptLoop() {
+        while (!stopping) {
+            if (waitReadable(listener, 200) <= 0) continue;
+
+            sockaddr_in peer{};
+            socklen_t peerLen = sizeof(peer);
+            socket_t client = ::accept(listener, (sockaddr*)&peer, &peerLen);
+            if (client == INVALID_SOCKET) continue;
+
+            // El POS se identifica por su IP para el reparto de la impresora
+            char ip[INET_ADDRSTRLEN] = "";
+            inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+            std::string source = ip;
+
+            std::lock_guard<std::mutex> lock(mtx);
+            reapFinished();
+
+            Connection& conn = connections.emplace_back();
+            std::string group = "raw:" + std::to_string(port) + ":" + std::to_string(++accepted);
+            conn.thread = std::thread([this, client, group, source, &conn] {
+                serve(client, group, source);
+                closeSocket(client);
+                conn.finished = true;
+            });
+        }
+    }
+
+    // Libera los hilos de conexiones ya cerradas (con mtx tomado)
+    void reapFinished() {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->finished) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Sigue los comandos ESC/POS de una conexión para reconocer los cortes
+    // sin confundirlos con datos: imágenes raster (GS v 0, ESC *, GS *),
+    // bloques con largo (GS ( , ESC ( , FS ( , GS 8 L) y códigos de barras
+    // (GS k) se saltean enteros. El estado sigue entre lecturas.
+    class CutScanner {
+    public:
+        // Avanza sobre d[0..n); devuelve lo consumido: hasta el final del
+        // primer corte (con cut = true) o n
+        size_t scan(const BYTE* d, size_t n, bool& cut) {
+            cut = false;
+            for (size_t i = 0; i < n; i++) {
+                if (step(d[i])) {
+                    cut = true;
+                    return i + 1;
+                }
+            }
+            return n;
+        }
+
+    private:
+        static constexpr BYTE DLE = 0x10, ESC = 0x1B, FS = 0x1C, GS = 0x1D;
+
+        enum class State { Text, Command, Args, Data, UntilNul };
+        State state = State::Text;
+        BYTE prefix = 0, op = 0;
+        BYTE args[8];
+        size_t need = 0, got = 0;
+        uint64_t left = 0;
+
+        // true al terminar un comando de corte
+        bool step(BYTE b) {
+            switch (state) {
+                case State::Text:
+                    if (b == ESC || b == GS || b == FS || b == DLE) {
+                        prefix = b;
+                        state = State::Command;
+                    }
+                    return false;
+                case State::Command:
+                    op = b;
+                    got = 0;
+                    need = argCount();
+                    if (need == 0) return done();
+                    state = State::Args;
+                    return false;
+                case State::Args:
+                    args[got++] = b;
+                    // GS V m [n]: con m >= 65 lleva n
+                    if (prefix == GS && op == 'V' && got == 1 && b >= 65) need = 2;
+                    // GS k m: m <= 6 termina en NUL; si no, viene n y n bytes
+                    if (prefix == GS && op == 'k' && got == 1 && b <= 6) {
+                        state = State::UntilNul;
+                        return false;
+                    }
+                    return got < need ? false : done();
+                case State::Data:
+                    if (--left == 0) state = State::Text;
+                    return false;
+                case State::UntilNul:
+                    if (b == 0) state = State::Text;
+                    return false;
+            }
+            return false;
+        }
+
+        // Bytes de parámetros fijos después del código de operación
+        size_t argCount() const {
+            if (prefix == DLE) return op == 0x04 || op == 0x05 ? 1 : op == 0x14 ? 3 : 0;
+            if (op == '(') return 3;                                // fn pL pH
+            if (prefix == ESC) {
+                switch (op) {
+                    case '!': case '%': case '-': case '3': case '?': case 'E': case 'G': case 'J':
+                    case 'M': case 'R': case 'T': case 'U': case 'V': case 'a': case 'd': case 'e':
+                    case 'r': case 't': case '{': case ' ':
+                        return 1;
+                    case '$': case '\\': case 'c':
+                        return 2;
+                    case 'p': case '*':
+                        return 3;
+                    case 'W':
+                        return 8;
+                    case 'D':
+                        return 0;       // tabulaciones hasta NUL: ver done()
+                }
+                return 0;
+            }
+            if (prefix == GS) {
+                switch (op) {
+                    case '!': case '/': case 'B': case 'H': case 'I': case 'T': case 'Z': case 'a':
+                    case 'b': case 'f': case 'h': case 'r': case 'w': case 'V':
+                        return 1;
+                    case '$': case 'L': case 'P': case 'W': case '\\': case '*': case 'k':
+                        return 2;       // GS k: m n (o m y datos hasta NUL)
+                    case '^':
+                        return 3;
+                    case '8':
+                        return 5;       // L p1 p2 p3 p4
+                    case 'v':
+                        return 6;       // 0 m xL xH yL yH
+                }
+                return 0;
+            }
+            switch (op) {               // FS
+                case '!': case '-': case 'C': case 'W':
+                    return 1;
+                case 'p': case 'S':
+                    return 2;
+            }
+            return 0;
+        }
+
+        // Parámetros completos: corte, datos a saltear o vuelta al texto
+        bool done() {
+            state = State::Text;
+            uint64_t data = 0;
+            if (op == '(' && prefix != DLE) {
+                data = args[1] | (uint64_t)args[2] << 8;
+            } else if (prefix == ESC) {
+                if (op == 'i' || op == 'm') return true;
+                if (op == '*') data = (args[1] | (uint64_t)args[2] << 8) * (args[0] <= 1 ? 1 : 3);
+                if (op == 'D') state = State::UntilNul;
+            } else if (prefix == GS) {
+                if (op == 'V') return true;
+                if (op == 'k') data = args[1];
+                if (op == '*') data = (uint64_t)args[0] * args[1] * 8;
+                if (op == '8') data = args[1] | (uint64_t)args[2] << 8 | (uint64_t)args[3] << 16 |
+                                      (uint64_t)args[4] << 24;
+                if (op == 'v') data = (args[2] | (uint64_t)args[3] << 8) * (args[4] | (uint64_t)args[5] << 8);
+            }
+            if (data > 0) {
+                left = data;
+                state = State::Data;
+            }
+            return false;
+        }
+    };
+
+    void serve(socket_t client, const std::string& group, const std::string& source) {
+        AllocTracker::setStage(AllocStageId::Raw);
+        std::vector<BYTE> data;
+        data.reserve(CHUNK);
+        CutScanner scanner;
+        auto lastRead = std::chrono::steady_clock::now();
+
+        while (!stopping) {
+            int ready = waitReadable(client, std::min(idleMs, 200));
+            if (ready < 0) break;
+
+            if (ready == 0) {
+                auto idle = std::chrono::steady_clock::now() - lastRead;
+                if (!data.empty() && idle >= std::chrono::milliseconds(idleMs)) {
+                    if (!flush(std::move(data), group, source)) break;
+                    data = std::vector<BYTE>();
+                    data.reserve(CHUNK);
+                }
+                continue;
+            }
+
+            // Lleno hasta lo que la cola admite: se encola y sigue en otro
+            const size_t limit = maxJobBytes(group);
+            if (data.size() >= limit) {
+                LOG_WARN("RAW {}: trabajo de {} bytes sin corte, se encola partido", port, data.size());
+                if (!flush(std::move(data), group, source)) break;
+                data = std::vector<BYTE>();
+                data.reserve(CHUNK);
+            }
+
+            // Mirar directo sobre el buffer del trabajo y consumir hasta el
+            // corte: los bytes siguientes se leen después en el buffer nuevo
+            size_t used = data.size();
+            const size_t room = std::min(CHUNK, limit - used);
+            data.resize(used + room);
+            auto n = ::recv(client, (char*)data.data() + used, (int)room, MSG_PEEK);
+            if (n <= 0) {
+                data.resize(used);
+                break;
+            }
+            bool cut = false;
+            const size_t take = scanner.scan(data.data() + used, (size_t)n, cut);
+            if (!consume(client, data.data() + used, take)) {
+                data.resize(used);
+                break;
+            }
+            data.resize(used + take);
+            lastRead = std::chrono::steady_clock::now();
+
+            if (cut) {
+                if (!flush(std::move(data), group, source)) break;
+                data = std::vector<BYTE>();
+                data.reserve(CHUNK);
+            }
+        }
+
+        if (!data.empty()) flush(std::move(data), group, source);
+    }
+
+    // Lee `n` bytes ya vistos con MSG_PEEK (quedan en el mismo lugar)
+    static bool consume(socket_t s, BYTE* out, size_t n) {
+        while (n > 0) {
+            auto r = ::recv(s, (char*)out, (int)n, 0);
+            if (r <= 0) return false;
+            out += r;
+            n -= (size_t)r;
+        }
+        return true;
+    }
+
+    // Tope de un trabajo para la impresora de esta conexión
+    size_t maxJobBytes(const std::string& group) {
+        PrintQueue* queue = spooler.resolve(printer, group);
+        return queue ? std::max(queue->maxJobBytes(), (size_t)1) : CHUNK;
+    }
+
+    // Encola el trabajo; si no hay lugar, espera (frenando la lectura del
+    // socket). false si no entrará nunca: se descarta y se cierra la conexión
+    bool flush(std::vector<BYTE>&& data, const std::string& group, const std::string& source) {
+        PrintQueue* queue = spooler.resolve(printer, group);
+        if (!queue) return true;
+
+        auto job = spooler.makeJob(std::move(data));
+        job->client = source;
+        TraceSpan span("raw", "admit", job->id);
+        AllocStage stage(AllocStageId::Admit);
+        while (!stopping) {
+            Admission adm = spooler.submit(*queue, job);
+            if (adm.accepted()) return true;
+            if (adm.tooLarge()) {
+                LOG_WARN("RAW {}: trabajo de {} bytes descartado, no entra en la cola de {}",
+                         port, job->queuedSize(), queue->getName());
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(
+                std::min(adm.retryAfter * 1000, 1000)));
+        }
+        return true;
+    }
+};
@@ -0,0 +1,153 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Scheduler - Impresión diferida ("marchar el segundo plato a las 21:15")
+// ============================================================================
+//
+// El trabajo se codifica al recibirlo y queda en la rueda de temporizadores
+// del spooler hasta su hora: al dispararse sólo hay que encolarlo. La
+// impresora (o el pool) se resuelve en ese momento, así aplican el reparto
+// y los respaldos vigentes. Si la cola está llena al dispararse, se
+// reintenta después del Retry-After en vez de perder el trabajo.
+//
+// Los pendientes tienen su propio límite (scheduled.max_jobs/max_bytes),
+// aparte del de las colas: no ocupan lugar de impresión hasta dispararse.
+
+#pragma once
+
+#include "config.h"
+#include "logger.h"
+#include "spooler.h"
+#include "timer_wheel.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Scheduler {
+public:
+    Scheduler(Spooler& spooler, const QueueLimits& limits)
+        : spooler(spooler), limits(limits) {}
+
+    // false si se superó el límite de trabajos programados
+    bool schedule(const std::string& printer, const std::string& group,
+                  const PrintJobPtr& job, std::chrono::system_clock::time_point when)
+    {
+        const size_t size = job->queuedSize();
+        std::lock_guard<std::mutex> lock(mtx);
+        if (pending.size() + 1 > limits.maxJobs || pendingBytes + size > limits.maxBytes)
+            return false;
+
+        Entry& e = pending[job->id];
+        e.printer = printer;
+        e.group   = group;
+        e.job     = job;
+        e.timer   = arm(job->id, steadyOf(when));
+        pendingBytes += size;
+        spooler.getTracker().publish(job->id, JobState::Scheduled, printer);
+        return true;
+    }
+
+    // false si no está programado o ya se está encolando
+    bool cancel(uint64_t id) {
+        PrintJobPtr job;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = pending.find(id);
+            if (it == pending.end() || it->second.firing) return false;
+            spooler.getTimers().cancel(it->second.timer);
+            job = it->second.job;
+            pendingBytes -= job->queuedSize();
+            pending.erase(it);
+        }
+        spooler.getTracker().publish(id, JobState::Cancelled);
+        job->done.set_value(false);
+        return true;
+    }
+
+    size_t pendingJobs() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return pending.size();
+    }
+
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return pendingBytes;
+    }
+
+    uint64_t firedJobs() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return fired;
+    }
+
+    const QueueLimits& getLimits() const { return limits; }
+
+private:
+    struct Entry {
+        std::string printer;
+        std::string group;
+        PrintJobPtr job;
+        TimerWheel::Id timer = 0;
+        bool firing = false;    // encolándose: ya no se cancela acá
+    };
+
+    Spooler& spooler;
+    QueueLimits limits;
+
+    mutable std::mutex mtx;
+    std::unordered_map<uint64_t, Entry> pending;
+    size_t pendingBytes = 0;
+    uint64_t fired = 0;
+
+    // La hora pedida es de reloj de pared; la rueda usa el reloj monótono
+    static std::chrono::steady_clock::time_point steadyOf(std::chrono::system_clock::time_point t) {
+        auto delta = t - std::chrono::system_clock::now();
+        return std::chrono::steady_clock::now() +
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(delta);
+    }
+
+    TimerWheel::Id arm(uint64_t id, std::chrono::steady_clock::time_point at) {
+        return spooler.getTimers().at(at, [this, id] { fire(id); });
+    }
+
+    // Hilo de la rueda: pasa el trabajo a su cola
+    void fire(uint64_t id) {
+        PrintJobPtr job;
+        std::string printer, group;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = pending.find(id);
+            if (it == pending.end()) return;
+            job     = it->second.job;
+            printer = it->second.printer;
+            group   = it->second.group;
+            it->second.firing = true;
+        }
+
+        PrintQueue* queue = spooler.resolve(printer, group);
+        Admission adm = queue ? spooler.submit(*queue, job) : Admission{404, 0};
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = pending.find(id);
+        if (it == pending.end()) return;
+
+        if (adm.accepted() || adm.status == 404 || adm.tooLarge()) {
+            if (!adm.accepted()) {
+                if (adm.tooLarge())
+                    LOG_WARN("Trabajo programado {}: no entra en la cola de {}", id, queue->getName());
+                else
+                    LOG_WARN("Trabajo programado {}: impresora desconocida {}", id, printer);
+                spooler.getTracker().publish(id, JobState::Failed, printer);
+                job->done.set_value(false);
+            }
+            pendingBytes -= job->queuedSize();
+            pending.erase(it);
+            fired++;
+            return;
+        }
+
+        // Cola llena: reintentar cuando se estima que haya lugar
+        it->second.firing = false;
+        it->second.timer = arm(id, std::chrono::steady_clock::now() +
+                                   std::chrono::seconds(std::max(adm.retryAfter, 1)));
+    }
+};
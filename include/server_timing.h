@@ -0,0 +1,94 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// ServerTiming - Duraciones por etapa en el header Server-Timing
+// ============================================================================
+//
+// Cada hilo HTTP atiende un pedido por vez: las etapas (parseo, codificación,
+// espera en la cola, escritura) se anotan en el ServerTiming del hilo y la
+// respuesta las manda como
+//
+//   Server-Timing: parse;dur=0.21, encode;dur=0.05, queue;dur=1.30,
+//                  write;dur=42.10, total;dur=44.02, job;desc="123"
+//
+// Duraciones en ms, de steady_clock. Las devtools del navegador las muestran
+// en la pestaña Timing del pedido (con Timing-Allow-Origin si es de otro
+// origen).
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class ServerTiming {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // El del pedido en curso en este hilo
+    static ServerTiming& current() {
+        thread_local ServerTiming t;
+        return t;
+    }
+
+    // Al entrar el pedido
+    void start() {
+        begin = Clock::now();
+        count = 0;
+    }
+
+    // Suma a la etapa `name` (un literal); la misma etapa puede repetirse
+    void add(const char* name, Clock::duration d) {
+        for (size_t i = 0; i < count; i++) {
+            if (stages[i].name == name) {
+                stages[i].elapsed += d;
+                return;
+            }
+        }
+        if (count < MAX_STAGES) stages[count++] = {name, d};
+    }
+
+    // Valor del header; jobId 0 = sin trabajo
+    std::string header(uint64_t jobId) const {
+        std::string out;
+        char buf[64];
+        for (size_t i = 0; i < count; i++) {
+            std::snprintf(buf, sizeof(buf), "%s;dur=%.2f, ", stages[i].name, ms(stages[i].elapsed));
+            out += buf;
+        }
+        std::snprintf(buf, sizeof(buf), "total;dur=%.2f", ms(Clock::now() - begin));
+        out += buf;
+        if (jobId) out += ", job;desc=\"" + std::to_string(jobId) + "\"";
+        return out;
+    }
+
+private:
+    static constexpr size_t MAX_STAGES = 8;
+
+    struct Stage {
+        const char* name;
+        Clock::duration elapsed;
+    };
+
+    Clock::time_point begin = Clock::now();
+    Stage stages[MAX_STAGES];
+    size_t count = 0;
+
+    static double ms(Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+};
+
+// Mide desde su construcción hasta su destrucción y lo suma a la etapa
+class TimingScope {
+public:
+    explicit TimingScope(const char* name) : name(name), start(ServerTiming::Clock::now()) {}
+    ~TimingScope() { ServerTiming::current().add(name, ServerTiming::Clock::now() - start); }
+
+    TimingScope(const TimingScope&) = delete;
+    TimingScope& operator=(const TimingScope&) = delete;
+
+private:
+    const char* name;
+    ServerTiming::Clock::time_point start;
+};
@@ -0,0 +1,451 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// SimulatedBackend - Impresora térmica simulada para medir sin hardware
+// ============================================================================
+//
+// Modela lo que hace lenta a una impresora real:
+//   - la transferencia (baud; 0 = USB/red, sin demora),
+//   - el mecanismo (mm/s): cada renglón avanza line_mm, cada código de
+//     barras barcode_mm y cada corte tarda cut_ms; las macros (GS : / GS ^)
+//     cuestan lo que imprimen,
+//   - el buffer de recepción: se acepta hasta buffer_bytes por delante del
+//     mecanismo y después write() espera a que se libere lugar, como un
+//     WritePrinter contra una impresora lenta.
+//
+// Y fallas con un cronograma determinista, por documento (at_doc: al
+// empezar el N-ésimo) o por tiempo (at_ms desde que se abrió el equipo):
+//   paper_out   el mecanismo para y las escrituras fallan durante `ms`
+//   cover_open  el mecanismo para; se acepta hasta llenar el buffer y
+//               después write() queda esperando hasta que se cierre
+//   stall       la comunicación se cuelga `ms` (lo corta el watchdog)
+//
+// El estado vive en un SimDevice por nombre de equipo, compartido por los
+// handles que se abren contra él: como el hardware, sobrevive a que el
+// watchdog recicle la conexión.
+//
+// Con "sink": "127.0.0.1:9300" lo escrito además se reenvía tal cual por TCP,
+// para que printagent-soak verifique byte a byte lo que "salió por el papel".
+// Una conexión por handle, que dura entre documentos (a cientos de
+// documentos por segundo, una por documento agota los puertos): cada
+// write() va como [largo u32 little-endian][bytes] y endDoc() manda un
+// largo 0. Si la conexión se corta a mitad, el documento quedó incompleto.
+
+#pragma once
+
+#include "httplib.h"
+#include "printer_backend.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct SimFault {
+    enum Kind { PaperOut, CoverOpen, Stall };
+    Kind kind = PaperOut;
+    uint64_t atDoc = 0;     // al empezar el documento N (desde 1); 0 = por tiempo
+    int64_t  atMs  = 0;     // ms desde que se abrió el equipo
+    int64_t  ms    = 0;     // duración
+};
+
+inline bool parseSimFault(const std::string& name, SimFault::Kind& out) {
+    if (name == "paper_out")  { out = SimFault::PaperOut;  return true; }
+    if (name == "cover_open") { out = SimFault::CoverOpen; return true; }
+    if (name == "stall")      { out = SimFault::Stall;     return true; }
+    return false;
+}
+
+struct SimSettings {
+    int    baud        = 0;         // 0 = USB/red
+    double mmPerSec    = 150.0;     // 0 = mecanismo instantáneo
+    double lineMm      = 4.23;      // avance de un renglón (1/6")
+    double barcodeMm   = 12.0;      // código de barras con su texto
+    int    cutMs       = 250;
+    size_t bufferBytes = 4096;
+    std::vector<SimFault> faults;
+    std::string sink;               // "host:port" que recibe cada documento ("" = no)
+};
+
+class SimDevice {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Un equipo por nombre; la configuración la pone quien lo abre primero
+    static std::shared_ptr<SimDevice> get(const std::string& name, const SimSettings& s) {
+        static std::mutex registryMtx;
+        static std::map<std::string, std::shared_ptr<SimDevice>> devices;
+        std::lock_guard<std::mutex> lock(registryMtx);
+        auto& d = devices[name];
+        if (!d) d = std::make_shared<SimDevice>(s);
+        return d;
+    }
+
+    explicit SimDevice(const SimSettings& s) : settings(s), epoch(Clock::now()), mechFree(epoch) {
+        for (auto& f : settings.faults) {
+            Trigger t;
+            t.fault = f;
+            if (!f.atDoc) t.start = epoch + std::chrono::milliseconds(f.atMs);
+            triggers.push_back(t);
+        }
+    }
+
+    bool beginDoc(const std::atomic<bool>& aborted) {
+        std::unique_lock<std::mutex> lock(mtx);
+        docs++;
+        const auto now = Clock::now();
+        for (auto& t : triggers)
+            if (t.fault.atDoc == docs) t.start = now;
+        refresh(now);
+        return !aborted && !active(SimFault::PaperOut, now);
+    }
+
+    // `accepted` se llama (sin el lock) por cada tramo que entra al buffer
+    bool write(const uint8_t* data, size_t size, const std::atomic<bool>& aborted,
+               const std::function<void()>& accepted = nullptr) {
+        // Tramos chicos: el buffer se libera de a poco, como en el equipo real
+        const size_t piece = std::clamp<size_t>(settings.bufferBytes / 2, 1, 512);
+        std::unique_lock<std::mutex> lock(mtx);
+
+        for (size_t off = 0; off < size; off += piece) {
+            const size_t n = std::min(piece, size - off);
+            if (off > 0 && accepted) {
+                lock.unlock();
+                accepted();
+                lock.lock();
+            }
+
+            // Lugar en el buffer, sin papel ni comunicación colgada
+            for (;;) {
+                if (aborted) return false;
+                const auto now = Clock::now();
+                refresh(now);
+                if (active(SimFault::PaperOut, now)) return false;
+
+                Clock::time_point until{};
+                if (active(SimFault::Stall, now, &until)) {
+                    cv.wait_until(lock, until);
+                    continue;
+                }
+                drain(now);
+                if (!pending.empty() && buffered + n > settings.bufferBytes) {
+                    cv.wait_until(lock, pending.front().first);
+                    continue;
+                }
+                break;
+            }
+
+            if (settings.baud > 0) {
+                const auto tx = Clock::now() + std::chrono::microseconds((int64_t)(n * 10 * 1e6 / settings.baud));
+                if (cv.wait_until(lock, tx, [&] { return aborted.load(); })) return false;
+            }
+
+            const double seconds = cost(data + off, n);
+            const auto now = Clock::now();
+            Clock::time_point start = std::max(now, mechFree);
+            Clock::time_point pausedUntil{};
+            if (paused(now, &pausedUntil)) start = std::max(start, pausedUntil);
+            mechFree = start + std::chrono::microseconds((int64_t)(seconds * 1e6));
+            pending.push_back({mechFree, n});
+            buffered += n;
+            written += n;
+        }
+        return true;
+    }
+
+    // Despierta a quien espera para que vea su `aborted`
+    void wake() {
+        std::lock_guard<std::mutex> lock(mtx);
+        cv.notify_all();
+    }
+
+    uint64_t documents() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return docs;
+    }
+
+    uint64_t bytesWritten() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return written;
+    }
+
+private:
+    static constexpr auto NEVER = Clock::time_point::max();
+
+    struct Trigger {
+        SimFault fault;
+        Clock::time_point start = NEVER;
+        bool applied = false;       // pausa ya corrida sobre lo que estaba en el buffer
+    };
+
+    // Avance del mecanismo: papel por imprimir y cortes
+    struct Cost {
+        double mm = 0;
+        int cuts = 0;
+    };
+
+    // Parser ESC/POS mínimo; el estado sigue entre escrituras
+    enum class Parse { Normal, Esc, EscFeed, Gs, GsCut, Skip, BarcodeType, BarcodeLen, BarcodeData, BarcodeNul, MacroRun };
+
+    SimSettings settings;
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    const Clock::time_point epoch;
+    std::vector<Trigger> triggers;
+    std::deque<std::pair<Clock::time_point, size_t>> pending;   // fin de impresión, bytes
+    size_t buffered = 0;
+    Clock::time_point mechFree;
+    uint64_t docs = 0;
+    uint64_t written = 0;
+
+    Parse state = Parse::Normal;
+    int skip = 0;
+    bool inMacro = false;
+    Cost macro;
+    std::vector<uint8_t> params;
+
+    bool active(SimFault::Kind kind, Clock::time_point now, Clock::time_point* until = nullptr) const {
+        for (auto& t : triggers) {
+            if (t.fault.kind != kind || t.start == NEVER) continue;
+            const auto end = t.start + std::chrono::milliseconds(t.fault.ms);
+            if (t.start <= now && now < end) {
+                if (until) *until = end;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool paused(Clock::time_point now, Clock::time_point* until) const {
+        Clock::time_point a{}, b{};
+        bool pa = active(SimFault::PaperOut, now, &a), pb = active(SimFault::CoverOpen, now, &b);
+        *until = std::max(pa ? a : Clock::time_point{}, pb ? b : Clock::time_point{});
+        return pa || pb;
+    }
+
+    // Una pausa que empieza corre lo que estaba en el buffer sin imprimir
+    void refresh(Clock::time_point now) {
+        for (auto& t : triggers) {
+            if (t.applied || t.start > now || t.fault.kind == SimFault::Stall) continue;
+            t.applied = true;
+            const auto shift = std::chrono::milliseconds(t.fault.ms);
+            for (auto& p : pending)
+                if (p.first > t.start) p.first += shift;
+            if (mechFree > t.start) mechFree += shift;
+        }
+    }
+
+    void drain(Clock::time_point now) {
+        while (!pending.empty() && pending.front().first <= now) {
+            buffered -= pending.front().second;
+            pending.pop_front();
+        }
+    }
+
+    double cost(const uint8_t* d, size_t n) {
+        Cost c;
+        for (size_t i = 0; i < n; i++) step(d[i], inMacro ? macro : c);
+        const double mm = settings.mmPerSec > 0 ? c.mm / settings.mmPerSec : 0.0;
+        return mm + c.cuts * settings.cutMs / 1000.0;
+    }
+
+    void step(uint8_t b, Cost& c) {
+        switch (state) {
+            case Parse::Normal:
+                if (b == 0x1B)      state = Parse::Esc;
+                else if (b == 0x1D) state = Parse::Gs;
+                else if (b == 0x0A) c.mm += settings.lineMm;
+                return;
+            case Parse::Esc:
+                if (b == 0x40)      state = Parse::Normal;      // ESC @
+                else if (b == 0x64) state = Parse::EscFeed;     // ESC d n
+                else                { state = Parse::Skip; skip = 1; }
+                return;
+            case Parse::EscFeed:
+                c.mm += b * settings.lineMm;
+                state = Parse::Normal;
+                return;
+            case Parse::Gs:
+                if (b == 0x56)      state = Parse::GsCut;       // GS V m [n]
+                else if (b == 0x6B) state = Parse::BarcodeType; // GS k m ...
+                else if (b == 0x3A) {                           // GS : define macro
+                    if (!inMacro) macro = Cost();
+                    inMacro = !inMacro;
+                    state = Parse::Normal;
+                } else if (b == 0x5E) {                         // GS ^ r t m
+                    params.clear();
+                    state = Parse::MacroRun;
+                } else {
+                    state = Parse::Skip;
+                    skip = 1;
+                }
+                return;
+            case Parse::GsCut:
+                c.cuts++;
+                if (b >= 65) { state = Parse::Skip; skip = 1; }
+                else         state = Parse::Normal;
+                return;
+            case Parse::BarcodeType:
+                c.mm += settings.barcodeMm;
+                state = b >= 65 ? Parse::BarcodeLen : Parse::BarcodeNul;
+                return;
+            case Parse::BarcodeLen:
+                skip = b;
+                state = skip ? Parse::BarcodeData : Parse::Normal;
+                return;
+            case Parse::BarcodeData:
+                if (--skip == 0) state = Parse::Normal;
+                return;
+            case Parse::BarcodeNul:
+                if (b == 0) state = Parse::Normal;
+                return;
+            case Parse::MacroRun:
+                params.push_back(b);
+                if (params.size() == 3) {
+                    c.mm   += params[0] * macro.mm;
+                    c.cuts += params[0] * macro.cuts;
+                    state = Parse::Normal;
+                }
+                return;
+            case Parse::Skip:
+                if (--skip <= 0) state = Parse::Normal;
+                return;
+        }
+    }
+};
+
+class SimulatedBackend : public PrinterBackend {
+public:
+    explicit SimulatedBackend(SimSettings s) : settings(std::move(s)) {}
+    ~SimulatedBackend() override { disconnect(); }
+
+    bool open(const std::string& name) override {
+        auto d = SimDevice::get(name, settings);
+        std::lock_guard<std::mutex> lock(mtx);
+        device = std::move(d);
+        return !aborted;
+    }
+
+    void close() override { disconnect(); }
+
+    // Corta también el envío al sink si quedó trabado. Con mtx: el hilo
+    // dueño no puede cerrar el socket entre la lectura y el shutdown (el
+    // descriptor podría ya ser de otra conexión)
+    void abort() override {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+        if (device) device->wake();
+        if (sink != INVALID_SOCKET) ::shutdown(sink, 2);   // SHUT_RDWR / SD_BOTH
+    }
+
+    bool beginDoc() override {
+        if (!device->beginDoc(aborted)) return false;
+        return settings.sink.empty() || sink != INVALID_SOCKET || connect();
+    }
+
+    bool write(const uint8_t* data, size_t size) override {
+        if (!device->write(data, size, aborted, [this] { advanced(); })) return false;
+        if (settings.sink.empty()) return true;
+        for (size_t off = 0; off < size; off += MAX_FRAME) {
+            const size_t n = std::min(MAX_FRAME, size - off);
+            if (!frame(data + off, n)) return false;
+        }
+        return true;
+    }
+
+    void endDoc() override {
+        if (!settings.sink.empty() && !frame(nullptr, 0)) disconnect();
+    }
+
+    std::string defaultDevice() override { return "sim"; }
+
+private:
+    SimSettings settings;
+    std::atomic<bool> aborted{false};
+
+    // El hilo dueño los escribe con mtx y los usa sin él; abort() los lee
+    // con mtx desde el watchdog
+    std::mutex mtx;
+    std::shared_ptr<SimDevice> device;
+    socket_t sink = INVALID_SOCKET;
+
+    static constexpr size_t MAX_FRAME = 1 << 20;
+
+    bool connect() {
+        disconnect();
+        const size_t colon = settings.sink.rfind(':');
+        if (colon == std::string::npos) return false;
+        const std::string host = settings.sink.substr(0, colon), port = settings.sink.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return false;
+
+        socket_t s = INVALID_SOCKET;
+        for (addrinfo* a = res; a && s == INVALID_SOCKET; a = a->ai_next) {
+            s = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (s == INVALID_SOCKET) continue;
+            if (::connect(s, a->ai_addr, (int)a->ai_addrlen) != 0) {
+                closeSocket(s);
+                s = INVALID_SOCKET;
+            }
+        }
+        freeaddrinfo(res);
+        if (s == INVALID_SOCKET) return false;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (aborted) {                  // abort() llegó antes de publicarlo
+            closeSocket(s);
+            return false;
+        }
+        sink = s;
+        return true;
+    }
+
+    bool frame(const uint8_t* data, size_t size) {
+        const uint8_t len[4] = {(uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24)};
+        if (send(len, sizeof(len)) && send(data, size)) return true;
+        disconnect();
+        return false;
+    }
+
+    bool send(const uint8_t* data, size_t size) {
+        const socket_t s = sink;
+        if (s == INVALID_SOCKET) return false;
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;     // sink caído: error, no SIGPIPE
+#else
+        const int flags = 0;
+#endif
+        while (size > 0) {
+            auto n = ::send(s, (const char*)data, (int)std::min<size_t>(size, 1 << 20), flags);
+            if (n <= 0) return false;
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (sink != INVALID_SOCKET) closeSocket(sink);
+        sink = INVALID_SOCKET;
+    }
+
+    static void closeSocket(socket_t s) {
+#ifdef _WIN32
+        closesocket(s);
+#else
+        ::close(s);
+#endif
+    }
+};
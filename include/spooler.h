@@ -0,0 +1,148 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Spooler - Colas por impresora lógica, pools y presupuesto global
+// ============================================================================
+
+#pragma once
+
+#include "alloc_tracker.h"
+#include "config.h"
+#include "flight_recorder.h"
+#include "history_store.h"
+#include "job_tracker.h"
+#include "print_queue.h"
+#include "printer_pool.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Spooler {
+public:
+    explicit Spooler(const AgentConfig& cfg)
+        : budget(cfg.globalLimits), clients(cfg.clients), defaultName(cfg.defaultPrinter)
+    {
+        for (auto& [name, pc] : cfg.printers)
+            queues[name] = std::make_unique<PrintQueue>(name, pc, budget, clients, timers, tracker);
+
+        for (auto& [name, pc] : cfg.printers)
+            if (!pc.fallback.empty()) queues[name]->setFallback(queues.at(pc.fallback).get());
+
+        for (auto& [name, memberNames] : cfg.pools) {
+            std::vector<PrintQueue*> members;
+            for (auto& m : memberNames) members.push_back(queues.at(m).get());
+            pools[name] = std::make_unique<PrinterPool>(std::move(members));
+        }
+
+        recorder.open(cfg.flightPath, cfg.flightBytes);
+        history.open(cfg.historyPath);
+        nextId = std::max(recorder.lastJobId(), history.lastJobId()) + 1;
+
+        for (auto& [_, q] : queues)
+            q->setPrintedHook([this](const PrintJobPtr& job, const std::string& printer) {
+                AllocStage stage(AllocStageId::Record);
+                history.append(job, printer);
+            });
+    }
+
+    // Impresora física configurada con ese nombre; nullptr si no existe
+    PrintQueue* find(const std::string& name) {
+        auto it = queues.find(name);
+        return it == queues.end() ? nullptr : it->second.get();
+    }
+
+    // Resuelve un nombre lógico ("" = por defecto, impresora o pool) a la
+    // cola que imprime el trabajo; nullptr si no existe
+    PrintQueue* resolve(const std::string& name, const std::string& group = "") {
+        const std::string& key = name.empty() ? defaultName : name;
+        auto pool = pools.find(key);
+        return route(pool != pools.end() ? pool->second->pick(group) : find(key));
+    }
+
+    // Sigue la cadena de respaldos mientras el breaker corte el tráfico
+    PrintQueue* route(PrintQueue* q) {
+        for (size_t hops = 0; q && hops < queues.size(); hops++) {
+            if (!q->getFallback() || q->healthy()) return q;
+            q = q->getFallback();
+        }
+        return q;
+    }
+
+    // Encola en `queue` y graba lo aceptado para poder reimprimirlo; en 503
+    // el Retry-After usa el vaciado de todo el agente
+    Admission submit(PrintQueue& queue, const PrintJobPtr& job) {
+        Admission a = queue.submit(job);
+        if (a.accepted()) {
+            AllocStage stage(AllocStageId::Record);
+            recorder.record(*job, queue.getName());
+        }
+        if (a.status == 503) {
+            DrainRate total{0.0, 0.0};
+            for (auto& [_, q] : queues) {
+                DrainRate r = q->drainRate();
+                total.bytesPerSec += r.bytesPerSec;
+                total.jobsPerSec  += r.jobsPerSec;
+            }
+            a.retryAfter = total.retryAfter(budget.queuedJobs(), budget.bytes());
+        }
+        return a;
+    }
+
+    // El buffer se mueve al trabajo, sin copiarse
+    PrintJobPtr makeJob(std::vector<BYTE> data) {
+        std::vector<Segment> segments;
+        segments.push_back({std::make_shared<const std::vector<BYTE>>(std::move(data)), 1});
+        return makeJob(std::move(segments));
+    }
+
+    PrintJobPtr makeJob(std::vector<Segment> segments) {
+        auto job = std::make_shared<PrintJob>();
+        job->id       = nextId.fetch_add(1);
+        job->segments = std::move(segments);
+        return job;
+    }
+
+    PrintJobPtr makeStreamJob(std::shared_ptr<ChunkStream> stream) {
+        auto job = std::make_shared<PrintJob>();
+        job->id     = nextId.fetch_add(1);
+        job->stream = std::move(stream);
+        return job;
+    }
+
+    void start() {
+        history.start();
+        timers.start();
+        for (auto& [_, q] : queues) q->start();
+    }
+
+    void stop() {
+        tracker.shutdown();
+        for (auto& [_, q] : queues) q->stop();
+        timers.stop();
+        history.stop();
+    }
+
+    const std::string& getDefaultName() const { return defaultName; }
+    const std::map<std::string, std::unique_ptr<PrintQueue>>& getQueues() const { return queues; }
+    const std::map<std::string, std::unique_ptr<PrinterPool>>& getPools() const { return pools; }
+    const GlobalBudget& getBudget() const { return budget; }
+    const ClientPolicy& getClients() const { return clients; }
+    TimerService& getTimers() { return timers; }
+    JobTracker& getTracker() { return tracker; }
+    const FlightRecorder& getRecorder() const { return recorder; }
+    const HistoryStore& getHistory() const { return history; }
+
+private:
+    GlobalBudget budget;
+    ClientPolicy clients;   // pesos y tope por cliente, compartidos por las colas
+    TimerService timers;    // plazos de escritura y trabajos programados
+    JobTracker tracker;     // estados para GET /jobs/{id} y /events
+    FlightRecorder recorder;
+    HistoryStore history;
+    std::string defaultName;
+    std::map<std::string, std::unique_ptr<PrintQueue>> queues;
+    std::map<std::string, std::unique_ptr<PrinterPool>> pools;
+    std::atomic<uint64_t> nextId{1};
+};
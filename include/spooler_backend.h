@@ -0,0 +1,145 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// SpoolerBackend - Impresión RAW por la cola de impresión de Windows
+// ============================================================================
+
+#pragma once
+
+#ifdef _WIN32
+
+#include "printer_backend.h"
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SpoolerBackend : public PrinterBackend {
+public:
+    ~SpoolerBackend() override { close(); }
+
+    static std::vector<std::string> listPrinters() {
+        std::vector<std::string> printers;
+        DWORD needed = 0, returned = 0;
+
+        EnumPrinters(PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS,
+                     NULL, 2, NULL, 0, &needed, &returned);
+
+        if (needed == 0) return printers;
+
+        std::vector<BYTE> buffer(needed);
+        PRINTER_INFO_2* info = (PRINTER_INFO_2*)buffer.data();
+
+        if (EnumPrinters(PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS,
+                         NULL, 2, buffer.data(), needed, &needed, &returned))
+        {
+            for (DWORD i = 0; i < returned; i++)
+                printers.emplace_back(info[i].pPrinterName);
+        }
+
+        return printers;
+    }
+
+    bool open(const std::string& name) override {
+        PRINTER_DEFAULTS pd = {NULL, NULL, PRINTER_ACCESS_USE};
+        HANDLE h = NULL;
+        if (!OpenPrinter((LPSTR)name.c_str(), &h, &pd)) {
+            error = GetLastError();
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        hPrinter = h;
+        return true;
+    }
+
+    // Sólo desde el hilo dueño, con su llamada ya vuelta (también tras abort)
+    void close() override {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (hPrinter) {
+            ClosePrinter(hPrinter);
+            hPrinter = NULL;
+        }
+    }
+
+    // Desde el watchdog: cancela el documento en el spooler para que la
+    // llamada colgada vuelva con error. El handle lo sigue usando esa
+    // llamada; lo cierra el hilo dueño en close()
+    void abort() override {
+        if (aborted.exchange(true)) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (hPrinter && jobId) SetJob(hPrinter, jobId, 0, NULL, JOB_CONTROL_CANCEL);
+    }
+
+    bool beginDoc() override {
+        if (aborted) return false;
+        DOC_INFO_1 doc;
+        doc.pDocName   = (LPSTR)"HIVA Print Job";
+        doc.pOutputFile= NULL;
+        doc.pDatatype  = (LPSTR)"RAW";
+
+        const DWORD id = StartDocPrinter(hPrinter, 1, (LPBYTE)&doc);
+        if (id == 0) {
+            error = GetLastError();
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            jobId = id;
+        }
+        if (aborted) {              // abort() llegó antes de que hubiera jobId
+            SetJob(hPrinter, id, 0, NULL, JOB_CONTROL_CANCEL);
+            EndDocPrinter(hPrinter);
+            return false;
+        }
+
+        if (!StartPagePrinter(hPrinter)) {
+            error = GetLastError();
+            EndDocPrinter(hPrinter);
+            return false;
+        }
+        return true;
+    }
+
+    // De a WRITE_CHUNK: cada tramo aceptado cuenta como avance para el watchdog
+    bool write(const uint8_t* data, size_t size) override {
+        for (size_t off = 0; off < size; off += WRITE_CHUNK) {
+            if (aborted) return false;
+            if (off > 0) advanced();
+            const DWORD n = (DWORD)std::min(WRITE_CHUNK, size - off);
+            DWORD written;
+            if (!WritePrinter(hPrinter, (LPVOID)(data + off), n, &written) || written != n) {
+                error = GetLastError();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void endDoc() override {
+        EndPagePrinter(hPrinter);
+        EndDocPrinter(hPrinter);
+        std::lock_guard<std::mutex> lock(mtx);
+        jobId = 0;
+    }
+
+    std::string defaultDevice() override {
+        auto printers = listPrinters();
+        return printers.empty() ? "" : printers[0];
+    }
+
+    unsigned long lastError() const override { return error; }
+
+private:
+    static constexpr size_t WRITE_CHUNK = 4096;
+
+    // El hilo dueño los escribe con mtx y los usa sin él; abort() los lee
+    // con mtx desde el watchdog
+    std::mutex mtx;
+    HANDLE hPrinter = NULL;
+    DWORD jobId = 0;
+    DWORD error = 0;
+    std::atomic<bool> aborted{false};
+};
+
+#endif
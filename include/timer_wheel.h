@@ -0,0 +1,245 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// TimerWheel - Rueda de temporizadores jerárquica
+// ============================================================================
+//
+// 4 niveles de 64 casilleros: con un tick de 10 ms cubre ~46 h. Programar y
+// cancelar es O(1) (listas intrusivas sobre un arreglo de nodos reciclados);
+// al dar la vuelta un nivel, su casillero siguiente baja al nivel de abajo.
+// Lo usan el watchdog de escrituras (se arma y desarma en cada write) y los
+// trabajos programados, que pueden ser decenas de miles.
+//
+// TimerWheel no es thread-safe; TimerService le agrega el mutex y el hilo
+// que la hace avanzar. Los callbacks corren en ese hilo, fuera del lock.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TimerWheel {
+public:
+    using Id       = uint64_t;      // 0 = ninguno
+    using Callback = std::function<void()>;
+
+    // Programa `fn` para el tick absoluto `at` (vencido = próximo tick)
+    Id schedule(uint64_t at, Callback fn) {
+        uint32_t i = allocNode();
+        Node& n = nodes[i];
+        n.at = at <= now ? now + 1 : at;
+        n.fn = std::move(fn);
+        place(i);
+        pending++;
+        return ((Id)n.gen << 32) | (i + 1);
+    }
+
+    bool cancel(Id id) {
+        uint32_t i = (uint32_t)(id & 0xFFFFFFFFu);
+        if (i == 0 || i > nodes.size()) return false;
+        Node& n = nodes[--i];
+        if (n.gen != (uint32_t)(id >> 32) || !n.linked) return false;
+        unlink(i);
+        freeNode(i);
+        pending--;
+        return true;
+    }
+
+    // Avanza hasta el tick `to` y junta los callbacks vencidos en `due`
+    void advance(uint64_t to, std::vector<Callback>& due) {
+        while (now < to) {
+            if (pending == 0) { now = to; break; }   // vacía: saltar directo
+            now++;
+            // Al completar una vuelta de un nivel, bajar el casillero siguiente
+            for (int l = 1; l < LEVELS; l++) {
+                if ((now & ((1ull << (BITS * l)) - 1)) != 0) break;
+                cascade(l, (size_t)((now >> (BITS * l)) & MASK));
+            }
+            uint32_t i = heads[slotOf(0, now)];
+            while (i != NIL) {
+                uint32_t next = nodes[i].next;
+                due.push_back(std::move(nodes[i].fn));
+                unlink(i);
+                freeNode(i);
+                pending--;
+                i = next;
+            }
+        }
+    }
+
+    uint64_t getNow() const { return now; }
+    size_t size() const { return pending; }
+
+private:
+    static constexpr int      LEVELS = 4;
+    static constexpr int      BITS   = 6;
+    static constexpr uint64_t SLOTS  = 1ull << BITS;
+    static constexpr uint64_t MASK   = SLOTS - 1;
+    static constexpr uint32_t NIL    = 0xFFFFFFFFu;
+
+    struct Node {
+        uint64_t at   = 0;
+        uint32_t prev = NIL, next = NIL;
+        uint32_t slot = 0;          // índice global del casillero
+        uint32_t gen  = 0;          // invalida ids viejos al reciclar
+        bool     linked = false;
+        Callback fn;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeList;
+    std::vector<uint32_t> heads = std::vector<uint32_t>(LEVELS * SLOTS, NIL);
+    uint64_t now = 0;
+    size_t pending = 0;
+
+    static size_t slotOf(int level, uint64_t tick) {
+        return level * SLOTS + ((tick >> (BITS * level)) & MASK);
+    }
+
+    uint32_t allocNode() {
+        if (!freeList.empty()) {
+            uint32_t i = freeList.back();
+            freeList.pop_back();
+            return i;
+        }
+        nodes.emplace_back();
+        return (uint32_t)nodes.size() - 1;
+    }
+
+    void freeNode(uint32_t i) {
+        nodes[i].fn = nullptr;
+        nodes[i].gen++;
+        freeList.push_back(i);
+    }
+
+    // Nivel según cuán lejos está el vencimiento; más allá del último nivel
+    // queda en su casillero y se reubica en cada vuelta
+    void place(uint32_t i) {
+        Node& n = nodes[i];
+        uint64_t delta = n.at - now;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (1ull << (BITS * (level + 1)))) level++;
+        uint64_t tick = n.at;
+        if (level == LEVELS - 1 && delta >= (1ull << (BITS * LEVELS)))
+            tick = now + (1ull << (BITS * LEVELS)) - 1;
+
+        n.slot = (uint32_t)slotOf(level, tick);
+        n.prev = NIL;
+        n.next = heads[n.slot];
+        if (n.next != NIL) nodes[n.next].prev = i;
+        heads[n.slot] = i;
+        n.linked = true;
+    }
+
+    void unlink(uint32_t i) {
+        Node& n = nodes[i];
+        if (n.prev != NIL) nodes[n.prev].next = n.next;
+        else               heads[n.slot] = n.next;
+        if (n.next != NIL) nodes[n.next].prev = n.prev;
+        n.linked = false;
+    }
+
+    void cascade(int level, size_t slot) {
+        uint32_t i = heads[level * SLOTS + slot];
+        heads[level * SLOTS + slot] = NIL;
+        while (i != NIL) {
+            uint32_t next = nodes[i].next;
+            nodes[i].linked = false;
+            place(i);
+            i = next;
+        }
+    }
+};
+
+// Rueda compartida con su propio hilo. Ociosa (sin temporizadores) no se
+// despierta; con temporizadores pendientes avanza un tick a la vez.
+class TimerService {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerService(std::chrono::milliseconds tick = std::chrono::milliseconds(10))
+        : tick(tick), origin(Clock::now()) {}
+
+    ~TimerService() { stop(); }
+
+    void start() {
+        thread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    TimerWheel::Id at(Clock::time_point when, TimerWheel::Callback fn) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (wheel.size() == 0) {
+            std::vector<TimerWheel::Callback> none;
+            wheel.advance(elapsedTicks(), none);
+        }
+        TimerWheel::Id id = wheel.schedule(tickOf(when), std::move(fn));
+        if (wheel.size() == 1) cv.notify_one();
+        return id;
+    }
+
+    TimerWheel::Id after(std::chrono::milliseconds delay, TimerWheel::Callback fn) {
+        return at(Clock::now() + delay, std::move(fn));
+    }
+
+    // false si ya se disparó (o está por dispararse): el callback debe
+    // tolerar llegar tarde
+    bool cancel(TimerWheel::Id id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return wheel.cancel(id);
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return wheel.size();
+    }
+
+private:
+    std::chrono::milliseconds tick;
+    Clock::time_point origin;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    TimerWheel wheel;
+    bool stopping = false;
+    std::thread thread;
+
+    // Redondea hacia arriba: nunca se dispara antes de tiempo
+    uint64_t tickOf(Clock::time_point t) const {
+        if (t <= origin) return 0;
+        auto d = t - origin;
+        return (uint64_t)((d + tick - Clock::duration(1)) / tick);
+    }
+
+    uint64_t elapsedTicks() const {
+        return (uint64_t)((Clock::now() - origin) / tick);
+    }
+
+    void run() {
+        std::vector<TimerWheel::Callback> due;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || wheel.size() > 0; });
+                if (stopping) return;
+                cv.wait_until(lock, origin + tick * (wheel.getNow() + 1), [this] { return stopping; });
+                if (stopping) return;
+                wheel.advance(elapsedTicks(), due);
+            }
+            for (auto& fn : due) fn();
+            due.clear();
+        }
+    }
+};
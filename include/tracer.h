@@ -0,0 +1,232 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Tracer - Línea de tiempo por trabajo en formato Chrome trace (Perfetto)
+// ============================================================================
+//
+// Tramos (TraceSpan) alrededor de cada etapa: parseo del JSON, codificación,
+// admisión, espera en la cola, apertura del documento y cada WritePrinter.
+// Fuera de una captura un tramo cuesta una lectura atómica. Durante la
+// captura cada hilo anota en su propio buffer (sin locks): un arreglo fijo
+// y un contador que se publica con release, así quien arma el trace lee
+// sólo lo ya escrito. Si el buffer se llena se cuentan los descartados.
+//
+// Las marcas de tiempo son del contador de ciclos (rdtsc, invariante en
+// los procesadores actuales) y se pasan a microsegundos al exportar,
+// comparándolas con steady_clock en el mismo intervalo. Donde no hay rdtsc
+// se usa steady_clock directamente.
+//
+// La espera en la cola no ocurre en un hilo: se exporta como evento
+// asíncrono por trabajo ("queued"), que Perfetto muestra en su propia pista.
+
+#pragma once
+
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HIVA_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HIVA_HAS_RDTSC 1
+#endif
+
+class Tracer {
+public:
+    struct Event {
+        const char* name;       // literales: no se copian
+        const char* cat;
+        uint64_t start;
+        uint64_t end;
+        uint64_t jobId;         // 0 = sin trabajo
+        bool     async;
+    };
+
+    static uint64_t ticks() {
+#ifdef HIVA_HAS_RDTSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static bool on() { return instance().active.load(std::memory_order_relaxed); }
+
+    // Anota un evento en el buffer del hilo (sólo durante una captura)
+    static void record(const Event& e) {
+        Tracer& t = instance();
+        const uint32_t gen = t.generation.load(std::memory_order_acquire);
+        Buffer& b = t.local();
+        if (b.gen.load(std::memory_order_relaxed) != gen) {
+            if (!b.events) b.events.reset(new Event[BUFFER_EVENTS]);
+            b.count.store(0, std::memory_order_relaxed);
+            b.dropped.store(0, std::memory_order_relaxed);
+            b.gen.store(gen, std::memory_order_release);
+        }
+        const size_t n = b.count.load(std::memory_order_relaxed);
+        if (n >= BUFFER_EVENTS) {
+            b.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        b.events[n] = e;
+        b.count.store(n + 1, std::memory_order_release);
+    }
+
+    // Nombre del hilo en el trace (si no, se usa la categoría de su primer evento)
+    static void nameThread(const std::string& name) {
+        Tracer& t = instance();
+        Buffer& b = t.local();
+        std::lock_guard<std::mutex> lock(t.mtx);
+        b.name = name;
+    }
+
+    // Captura `duration` y devuelve el trace; false si ya hay otra en curso
+    static bool capture(std::chrono::milliseconds duration, nlohmann::json& trace) {
+        Tracer& t = instance();
+        if (t.capturing.exchange(true)) return false;
+
+        const uint64_t tick0 = ticks();
+        const auto time0 = std::chrono::steady_clock::now();
+        const uint32_t gen = t.generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+        t.active.store(true, std::memory_order_release);
+
+        std::this_thread::sleep_for(duration);
+
+        t.active.store(false, std::memory_order_release);
+        const uint64_t tick1 = ticks();
+        const double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - time0).count();
+        const double ticksPerUs = us > 0 && tick1 > tick0 ? (tick1 - tick0) / us : 1.0;
+
+        trace = t.render(gen, tick0, ticksPerUs);
+        t.capturing.store(false);
+        return true;
+    }
+
+private:
+    static constexpr size_t BUFFER_EVENTS = 4096;   // por hilo y captura
+
+    struct Buffer {
+        std::unique_ptr<Event[]> events;    // al primer evento: no todo hilo traza
+        std::atomic<size_t>   count{0};
+        std::atomic<uint32_t> gen{0};
+        std::atomic<uint64_t> dropped{0};
+        int tid = 0;
+        std::string name;           // con mtx
+        std::atomic<bool> alive{true};
+    };
+
+    // Marca el buffer como libre cuando termina el hilo
+    struct Owner {
+        std::shared_ptr<Buffer> buffer;
+        ~Owner() { if (buffer) buffer->alive.store(false); }
+    };
+
+    std::atomic<bool> active{false};
+    std::atomic<bool> capturing{false};
+    std::atomic<uint32_t> generation{0};
+
+    std::mutex mtx;
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    int nextTid = 1;
+
+    static Tracer& instance() {
+        static Tracer t;
+        return t;
+    }
+
+    Buffer& local() {
+        thread_local Owner owner;
+        if (!owner.buffer) {
+            auto b = std::make_shared<Buffer>();
+            std::lock_guard<std::mutex> lock(mtx);
+            // Los hilos que ya terminaron (conexiones RAW, workers
+            // abandonados) sólo se guardan hasta la próxima captura
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [this](auto& x) {
+                return !x->alive.load() && x->gen.load() != generation.load();
+            }), buffers.end());
+            b->tid = nextTid++;
+            buffers.push_back(b);
+            owner.buffer = std::move(b);
+        }
+        return *owner.buffer;
+    }
+
+    nlohmann::json render(uint32_t gen, uint64_t tick0, double ticksPerUs) {
+        using nlohmann::json;
+        auto us = [&](uint64_t t) { return t > tick0 ? (t - tick0) / ticksPerUs : 0.0; };
+
+        json events = json::array();
+        uint64_t dropped = 0;
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& b : buffers) {
+            if (b->gen.load(std::memory_order_acquire) != gen) continue;
+            const size_t n = b->count.load(std::memory_order_acquire);
+            if (n == 0) continue;
+            dropped += b->dropped.load(std::memory_order_relaxed);
+
+            std::string name = b->name.empty()
+                ? std::string(b->events[0].cat) + "-" + std::to_string(b->tid) : b->name;
+            events.push_back({{"ph", "M"}, {"name", "thread_name"}, {"pid", 1}, {"tid", b->tid},
+                              {"args", {{"name", name}}}});
+
+            for (size_t i = 0; i < n; i++) {
+                const Event& e = b->events[i];
+                json args = json::object();
+                if (e.jobId) args["job_id"] = e.jobId;
+                if (e.async) {
+                    // Un par b/e por trabajo: su propia pista en Perfetto
+                    json base = {{"name", e.name}, {"cat", e.cat}, {"pid", 1}, {"tid", b->tid},
+                                 {"id", std::to_string(e.jobId)}};
+                    json begin = base, end = base;
+                    begin["ph"] = "b"; begin["ts"] = us(e.start); begin["args"] = args;
+                    end["ph"]   = "e"; end["ts"]   = us(e.end);
+                    events.push_back(std::move(begin));
+                    events.push_back(std::move(end));
+                } else {
+                    events.push_back({{"ph", "X"}, {"name", e.name}, {"cat", e.cat}, {"pid", 1},
+                                      {"tid", b->tid}, {"ts", us(e.start)},
+                                      {"dur", (e.end - e.start) / ticksPerUs}, {"args", args}});
+                }
+            }
+        }
+        events.push_back({{"ph", "M"}, {"name", "process_name"}, {"pid", 1}, {"tid", 0},
+                          {"args", {{"name", "PrintAgent"}}}});
+
+        return {{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"},
+                {"otherData", {{"dropped_events", dropped}}}};
+    }
+};
+
+// Tramo RAII: anota desde su construcción hasta su destrucción. Fuera de
+// una captura no hace nada.
+class TraceSpan {
+public:
+    TraceSpan(const char* cat, const char* name, uint64_t jobId = 0)
+        : cat(cat), name(name), jobId(jobId), start(Tracer::on() ? Tracer::ticks() : 0) {}
+
+    ~TraceSpan() {
+        if (start) Tracer::record({name, cat, start, Tracer::ticks(), jobId, false});
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    // El id del trabajo a veces se conoce después de abrir el tramo
+    void job(uint64_t id) { jobId = id; }
+
+private:
+    const char* cat;
+    const char* name;
+    uint64_t jobId;
+    uint64_t start;
+};
@@ -0,0 +1,46 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// Sondas USDT (provider "printagent") para bpftrace / perf en Linux
+// ============================================================================
+//
+// Con <sys/sdt.h> (paquete systemtap-sdt-dev) cada HIVA_PROBE queda como un
+// NOP en el código más una nota ELF; bpftrace la reemplaza por un trap sólo
+// mientras está enganchado. Sin el header (Windows, o Linux sin el paquete)
+// no genera código ni evalúa los argumentos. -DHIVA_NO_USDT las apaga.
+// CMake (opción PRINTAGENT_USDT) define HIVA_USDT cuando encontró el header:
+// entonces faltarlo es un error, no un build sin sondas sin aviso.
+//
+// Los argumentos se evalúan aunque nadie escuche, así que son baratos:
+// enteros, c_str() y a lo sumo una suma por tanda.
+//
+//   http_request   (method, path, body_bytes)
+//   encode_start   (kind)
+//   encode_end     (kind, bytes)
+//   job_enqueue    (job_id, printer, bytes, priority)
+//   write_start    (job_id, printer, bytes, jobs)      tanda: job_id es el primero
+//   write_end      (job_id, printer, written, ok)
+//   printer_state  (printer, online)
+//   breaker_state  (printer, state)                     "closed", "open", "half_open"
+//
+// Ejemplo: latencia de escritura por impresora
+//   bpftrace -e 'usdt:./PrintAgent:printagent:write_start { @s[arg0] = nsecs; }
+//     usdt:./PrintAgent:printagent:write_end /@s[arg0]/ {
+//       @us[str(arg1)] = hist((nsecs - @s[arg0]) / 1000); delete(@s[arg0]); }'
+
+#pragma once
+
+#if defined(HIVA_USDT) && !defined(HIVA_NO_USDT)
+#include <sys/sdt.h>
+#define HIVA_HAS_USDT 1
+#elif defined(__linux__) && !defined(HIVA_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HIVA_HAS_USDT 1
+#endif
+#endif
+
+#ifdef HIVA_HAS_USDT
+#define HIVA_PROBE(name, ...) STAP_PROBEV(printagent, name, __VA_ARGS__)
+#else
+#define HIVA_PROBE(name, ...) do {} while (0)
+#endif
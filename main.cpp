@@ -5,178 +5,527 @@
 
 #include "httplib.h"
 #include "json.hpp"
+#include "alloc_tracker.h"
+#include "config.h"
+#include "dedup_cache.h"
+#include "escpos_printer.h"
+#include "job_tracker.h"
+#include "logger.h"
+#include "prepared_store.h"
+#include "print_queue.h"
+#include "raw_ingress.h"
+#include "scheduler.h"
+#include "server_timing.h"
+#include "spooler.h"
+#include "tracer.h"
+#include "usdt.h"
+#ifdef _WIN32
 #include <windows.h>
 #include <setupapi.h>
-#include <iostream>
+#endif
+#include <charconv>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
 #include <string>
 
 using json = nlohmann::json;
 
 // ============================================================================
-// Clase ESCPOSPrinter - Manejo de impresoras térmicas ESC/POS
+// API HTTP
 // ============================================================================
 
-class ESCPOSPrinter {
-private:
-    HANDLE hPrinter;
-    std::string printerName;
-    bool isOpen;
+std::unique_ptr<Spooler>   spooler;
+std::unique_ptr<Scheduler> scheduler;
+std::unique_ptr<PreparedStore> prepared;
+DedupCache                 dedup;
 
-    const std::vector<BYTE> ESC_INIT        = {0x1B, 0x40};
-    const std::vector<BYTE> ESC_ALIGN_LEFT  = {0x1B, 0x61, 0x00};
-    const std::vector<BYTE> ESC_ALIGN_CENTER= {0x1B, 0x61, 0x01};
-    const std::vector<BYTE> ESC_FEED        = {0x0A};
-    const std::vector<BYTE> ESC_CUT         = {0x1D, 0x56, 0x00};
+// Resultado de un pedido de impresión tal como se responde al POS
+struct PrintOutcome {
+    int      status     = 200;
+    bool     success    = false;
+    uint64_t jobId      = 0;
+    int      retryAfter = 0;
+    std::string error;
+    int64_t  fireAt     = 0;    // trabajo programado: hora de disparo (epoch ms)
+};
 
-public:
-    ESCPOSPrinter() : hPrinter(NULL), isOpen(false) {}
-    ~ESCPOSPrinter() { close(); }
+struct BadRequest : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
-    static std::vector<std::string> listPrinters() {
-        std::vector<std::string> printers;
-        DWORD needed = 0, returned = 0;
+// Opciones comunes de un trabajo, del cuerpo JSON o de la query string
+struct JobOptions {
+    std::string printer;    // impresora o pool ("" = por defecto)
+    std::string group;      // trabajos de varias partes van al mismo equipo
+    Priority    priority = Priority::Normal;
+    bool        scheduled = false;                  // fire_at / delay_ms
+    std::chrono::system_clock::time_point fireAt;
+    bool        async = false;      // responder al encolar; el resultado va por /jobs y /events
+    std::string client;             // reparto justo de la impresora entre POS
+    std::string ticket;             // ticket_id del POS: buscar el trabajo para reimprimirlo
+};
 
-        EnumPrinters(PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS,
-                     NULL, 2, NULL, 0, &needed, &returned);
+// Entero en [lo, hi] de un parámetro o campo; si no, 400
+int64_t intParam(const std::string& name, const std::string& s, int64_t lo, int64_t hi) {
+    int64_t v = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (s.empty() || ec != std::errc() || end != s.data() + s.size() || v < lo || v > hi)
+        throw BadRequest(name + " invalido: " + s);
+    return v;
+}
 
-        if (needed == 0) return printers;
+int64_t epochMs(std::chrono::system_clock::time_point t) {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(t.time_since_epoch()).count();
+}
 
-        std::vector<BYTE> buffer(needed);
-        PRINTER_INFO_2* info = (PRINTER_INFO_2*)buffer.data();
+// Hora local de `t`; std::localtime comparte un buffer entre hilos HTTP
+std::tm localTm(std::time_t t) {
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    return tm;
+}
 
-        if (EnumPrinters(PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS,
-                         NULL, 2, buffer.data(), needed, &needed, &returned))
-        {
-            for (DWORD i = 0; i < returned; i++)
-                printers.emplace_back(info[i].pPrinterName);
-        }
+// Cliente que comparte la impresora: X-Client-Id (token de la terminal)
+// o, si no lo manda, la IP de origen
+std::string clientOf(const httplib::Request& req) {
+    std::string id = req.get_header_value("X-Client-Id");
+    return id.empty() ? req.remote_addr : id;
+}
 
-        return printers;
-    }
+// Prioridad pedida por el POS ("urgent", "normal", "bulk"); vacía = `def`
+Priority priorityOf(const std::string& name, Priority def) {
+    if (name.empty()) return def;
+    Priority p;
+    if (!parsePriority(name, p)) throw BadRequest("prioridad invalida: " + name);
+    return p;
+}
 
-    bool open(const std::string& name = "") {
-        if (isOpen) return true;
+// Hora de disparo de un trabajo programado. fire_at acepta epoch en ms,
+// "HH:MM[:SS]" (la próxima vez que llegue esa hora) o
+// "AAAA-MM-DDTHH:MM[:SS]", en hora local; delay_ms es relativo a ahora.
+const auto MAX_SCHEDULE_AHEAD = std::chrono::hours(24 * 7);
 
-        if (name.empty()) {
-            auto printers = listPrinters();
-            if (printers.empty()) {
-                std::cerr << "[HIVA] No se encontraron impresoras instaladas.\n";
-                return false;
-            }
-            printerName = printers[0];
-        } else {
-            printerName = name;
-        }
+void scheduleFrom(JobOptions& o, const std::string& fireAt, const std::string& delayMs) {
+    using namespace std::chrono;
+    if (fireAt.empty() && delayMs.empty()) return;
+    if (!fireAt.empty() && !delayMs.empty()) throw BadRequest("fire_at y delay_ms son excluyentes");
 
-        PRINTER_DEFAULTS pd = {NULL, NULL, PRINTER_ACCESS_USE};
-        if (!OpenPrinter((LPSTR)printerName.c_str(), &hPrinter, &pd)) {
-            std::cerr << "[HIVA] Error al abrir impresora. Codigo: " << GetLastError() << "\n";
-            return false;
-        }
+    // Los valores numéricos se acotan antes de sumarlos: uno enorme
+    // desbordaría el time_point y pasaría el control de MAX_SCHEDULE_AHEAD
+    auto now = system_clock::now();
+    const int64_t maxAhead = duration_cast<milliseconds>(MAX_SCHEDULE_AHEAD).count();
+    if (!delayMs.empty()) {
+        int64_t ms = intParam("delay_ms", delayMs, 0, std::numeric_limits<int64_t>::max());
+        if (ms > maxAhead) throw BadRequest("delay_ms demasiado lejano (max. 7 dias)");
+        o.fireAt = now + milliseconds(ms);
+    } else if (fireAt.find_first_not_of("0123456789") == std::string::npos) {
+        int64_t ms = intParam("fire_at", fireAt, 0, std::numeric_limits<int64_t>::max());
+        if (ms > epochMs(now) + maxAhead) throw BadRequest("fire_at demasiado lejano (max. 7 dias)");
+        o.fireAt = system_clock::time_point(milliseconds(ms));
+    } else {
+        std::tm tm = localTm(system_clock::to_time_t(now));
+        tm.tm_sec = 0;
 
-        isOpen = true;
-        return true;
-    }
+        std::istringstream in(fireAt);
+        bool timeOnly = fireAt.find('-') == std::string::npos;
+        in >> std::get_time(&tm, timeOnly ? "%H:%M" : "%Y-%m-%dT%H:%M");
+        if (in.fail()) throw BadRequest("fire_at invalido: " + fireAt);
+        if (in.peek() == ':') in.ignore() >> tm.tm_sec;
+        tm.tm_isdst = -1;
 
-    void close() {
-        if (isOpen && hPrinter) {
-            ClosePrinter(hPrinter);
-            hPrinter = NULL;
-            isOpen = false;
+        o.fireAt = system_clock::from_time_t(std::mktime(&tm));
+        if (timeOnly && o.fireAt <= now) {
+            tm.tm_mday++;
+            tm.tm_isdst = -1;
+            o.fireAt = system_clock::from_time_t(std::mktime(&tm));
         }
     }
 
-    bool sendRaw(const std::vector<BYTE>& data) {
-        if (!isOpen) return false;
+    if (o.fireAt > now + MAX_SCHEDULE_AHEAD) throw BadRequest("fire_at demasiado lejano (max. 7 dias)");
+    o.scheduled = true;
+}
 
-        DOC_INFO_1 doc;
-        doc.pDocName   = (LPSTR)"HIVA Print Job";
-        doc.pOutputFile= NULL;
-        doc.pDatatype  = (LPSTR)"RAW";
+std::string jsonScalar(const json& body, const char* key) {
+    if (!body.contains(key)) return "";
+    const json& v = body[key];
+    return v.is_string() ? v.get<std::string>() : std::to_string(v.get<int64_t>());
+}
 
-        DWORD job = StartDocPrinter(hPrinter, 1, (LPBYTE)&doc);
-        if (job == 0) return false;
+JobOptions optionsFrom(const httplib::Request& req, const json& body, Priority def) {
+    JobOptions o;
+    o.client   = clientOf(req);
+    o.printer  = body.value("printer", "");
+    o.group    = body.value("group", "");
+    o.priority = priorityOf(body.value("priority", ""), def);
+    o.async    = body.value("async", false);
+    o.ticket   = jsonScalar(body, "ticket_id");
+    scheduleFrom(o, jsonScalar(body, "fire_at"), jsonScalar(body, "delay_ms"));
+    return o;
+}
 
-        if (!StartPagePrinter(hPrinter)) {
-            EndDocPrinter(hPrinter);
-            return false;
-        }
+JobOptions optionsFrom(const httplib::Request& req, Priority def) {
+    JobOptions o;
+    o.client   = clientOf(req);
+    o.printer  = req.get_param_value("printer");
+    o.group    = req.get_param_value("group");
+    o.priority = priorityOf(req.get_param_value("priority"), def);
+    o.async    = req.get_param_value("async") == "1" || req.get_param_value("async") == "true";
+    o.ticket   = req.get_param_value("ticket_id");
+    scheduleFrom(o, req.get_param_value("fire_at"), req.get_param_value("delay_ms"));
+    return o;
+}
 
-        DWORD written;
-        BOOL ok = WritePrinter(hPrinter, (LPVOID)data.data(), data.size(), &written);
+// Hora de una consulta al historial: epoch en ms, "HH:MM" (de hoy),
+// "AAAA-MM-DD" o "AAAA-MM-DDTHH:MM[:SS]", en hora local
+int64_t historyTime(const std::string& s) {
+    using namespace std::chrono;
+    if (s.find_first_not_of("0123456789") == std::string::npos)
+        return intParam("hora", s, 0, std::numeric_limits<int64_t>::max());
 
-        EndPagePrinter(hPrinter);
-        EndDocPrinter(hPrinter);
-        return ok;
-    }
+    std::tm tm = localTm(system_clock::to_time_t(system_clock::now()));
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
 
-    bool printTicket(const std::vector<std::string>& lines) {
-        if (!open()) return false;
+    std::istringstream in(s);
+    if (s.find('-') == std::string::npos)   in >> std::get_time(&tm, "%H:%M");
+    else if (s.find('T') == std::string::npos) in >> std::get_time(&tm, "%Y-%m-%d");
+    else                                    in >> std::get_time(&tm, "%Y-%m-%dT%H:%M");
+    if (in.fail()) throw BadRequest("hora invalida: " + s);
+    if (in.peek() == ':') in.ignore() >> tm.tm_sec;
+    tm.tm_isdst = -1;
+    return epochMs(system_clock::from_time_t(std::mktime(&tm)));
+}
 
-        std::vector<BYTE> data;
-        data.insert(data.end(), ESC_INIT.begin(), ESC_INIT.end());
-        data.insert(data.end(), ESC_ALIGN_LEFT.begin(), ESC_ALIGN_LEFT.end());
+// Filtros del historial: ?table=12&order=&ticket_id=&printer=&q=palabras
+// &since=&until=&limit=
+HistoryStore::Query historyQuery(const httplib::Request& req, size_t maxLimit) {
+    HistoryStore::Query q;
+    auto term = [&](const char* param, const char* prefix) {
+        if (req.has_param(param))
+            q.terms.push_back(prefix + HistoryStore::lower(req.get_param_value(param)));
+    };
+    term("table", "table:");
+    term("order", "order:");
+    term("ticket_id", "ticket:");
+    term("printer", "printer:");
+    for (auto& t : HistoryStore::termsOf(req.get_param_value("q"))) q.terms.push_back(t);
 
-        for (auto& line : lines) {
-            data.insert(data.end(), line.begin(), line.end());
-            data.push_back(0x0A);
-        }
+    if (req.has_param("since")) q.since = historyTime(req.get_param_value("since"));
+    if (req.has_param("until")) q.until = historyTime(req.get_param_value("until"));
+    if (req.has_param("limit"))     // de más se recorta, no es error
+        q.limit = intParam("limit", req.get_param_value("limit"), 1, std::numeric_limits<int64_t>::max());
+    q.limit = std::min(q.limit, maxLimit);
+    return q;
+}
+
+// Espera en la cola y escritura de un trabajo ya resuelto, para Server-Timing.
+// `admitted` es cuando terminó la admisión (la tanda pudo empezar antes).
+void timePrinted(const PrintJob& job, ServerTiming::Clock::time_point admitted) {
+    if (job.printedAt == ServerTiming::Clock::time_point{}) return;
+    ServerTiming& t = ServerTiming::current();
+    t.add("queue", std::max(job.printStartedAt - admitted, ServerTiming::Clock::duration::zero()));
+    t.add("write", job.printedAt - job.printStartedAt);
+}
 
-        data.insert(data.end(), ESC_CUT.begin(), ESC_CUT.end());
-        return sendRaw(data);
+std::string admissionError(const Admission& adm) {
+    if (adm.tooLarge())       return "trabajo demasiado grande para la cola de la impresora";
+    if (adm.status == 429)    return "cola de impresora llena";
+    return "agente saturado";
+}
+
+// Encola un trabajo ya codificado en la impresora pedida y espera a que se imprima
+PrintOutcome submitJob(const JobOptions& opts, const PrintJobPtr& job) {
+    PrintQueue* queue = spooler->resolve(opts.printer, opts.group);
+    if (!queue) return {404, false, 0, 0, "impresora desconocida"};
+
+    job->priority = opts.priority;
+    job->client   = opts.client;
+    job->ticket   = opts.ticket;
+
+    // Programado: ya quedó codificado; se responde sin esperar la impresión
+    if (opts.scheduled) {
+        if (!scheduler->schedule(opts.printer, opts.group, job, opts.fireAt))
+            return {503, false, 0, 60, "demasiados trabajos programados"};
+        return {202, true, job->id, 0, "", epochMs(opts.fireAt)};
     }
 
-    bool printBarcode(const std::vector<std::string>& codes,
-                      int copies, const std::string& text)
+    Admission adm;
     {
-        if (!open()) return false;
+        TraceSpan span("http", "admit", job->id);
+        AllocStage stage(AllocStageId::Admit);
+        TimingScope timing("admit");
+        adm = spooler->submit(*queue, job);
+    }
+    if (!adm.accepted()) return {adm.status, false, 0, adm.retryAfter, admissionError(adm)};
 
-        std::vector<BYTE> data;
-        data.insert(data.end(), ESC_INIT.begin(), ESC_INIT.end());
-        data.insert(data.end(), ESC_ALIGN_CENTER.begin(), ESC_ALIGN_CENTER.end());
+    // Recién ahora: un trabajo rechazado puede volver a intentarse (commit)
+    // y el futuro de la promesa sólo se puede pedir una vez
+    auto done = job->done.get_future();
+    if (opts.async) return {202, true, job->id, 0, ""};
+    TraceSpan span("http", "wait printed", job->id);
+    const auto admitted = ServerTiming::Clock::now();
+    bool printed = done.get();
+    timePrinted(*job, admitted);
+    return {200, printed, job->id, 0, ""};
+}
 
-        for (int c = 0; c < copies; c++) {
-            if (!text.empty()) {
-                data.insert(data.end(), text.begin(), text.end());
-                data.push_back(0x0A);
-            }
+PrintOutcome printSegments(const JobOptions& opts, std::vector<Segment> segments) {
+    return submitJob(opts, spooler->makeJob(std::move(segments)));
+}
+
+// Impresión en streaming: el cuerpo es texto plano, una línea por renglón
+// (ticket) o por código (etiquetas). Cada línea se codifica apenas llega y
+// los bloques salen hacia la impresora mientras sigue la subida.
+const size_t STREAM_CHUNK    = 4096;
+const size_t STREAM_DEPTH    = 8;
+const size_t STREAM_MAX_LINE = 4096;
+const int    STREAM_MAX_COPIES = 1000;    // también tope de copies en /print/barcode
+
+// Codifica una línea en `out`; llama a flushFull() en cada unidad para que
+// la memoria no crezca con la línea (copias). false si el canal se cortó.
+using LineEncoder = std::function<bool(ChunkWriter&, const std::string&)>;
+
+PrintOutcome printStream(const JobOptions& opts, const httplib::ContentReader& reader,
+                         const std::vector<BYTE>& head, const LineEncoder& encodeLine,
+                         const std::vector<BYTE>& tail)
+{
+    if (opts.scheduled) throw BadRequest("un streaming no se puede programar");
+    PrintQueue* queue = spooler->resolve(opts.printer, opts.group);
+    if (!queue) return {404, false, 0, 0, "impresora desconocida"};
+
+    auto stream = std::make_shared<ChunkStream>(STREAM_CHUNK, STREAM_DEPTH);
+    auto job = spooler->makeStreamJob(stream);
+    job->priority = opts.priority;
+    job->client   = opts.client;
+    job->ticket   = opts.ticket;
+    auto done = job->done.get_future();
+
+    // Se codifica mientras llega el cuerpo, antes y durante la impresión
+    spooler->getTracker().publish(job->id, JobState::Encoding, queue->getName());
+
+    Admission adm = spooler->submit(*queue, job);
+    if (!adm.accepted()) return {adm.status, false, 0, adm.retryAfter, admissionError(adm)};
+
+    ChunkWriter out(*stream);
+    out.buf().insert(out.buf().end(), head.begin(), head.end());
+
+    std::string line;
+    auto emit = [&] {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        bool ok = encodeLine(out, line);
+        line.clear();
+        return ok;
+    };
 
-            for (auto& code : codes) {
-                std::vector<BYTE> bc = {0x1D, 0x6B, 0x43, 0x0C};
-                bc.insert(bc.end(), code.begin(), code.end());
-                data.insert(data.end(), bc.begin(), bc.end());
-                data.push_back(0x0A);
+    bool received = reader([&](const char* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] == '\n') {
+                if (!emit()) return false;
+            } else if (line.size() < STREAM_MAX_LINE) {
+                line.push_back(data[i]);
             }
         }
+        return true;
+    });
+
+    if (received && !line.empty()) received = emit();
+    out.buf().insert(out.buf().end(), tail.begin(), tail.end());
+
+    if (!received) stream->abort();
+    out.finish();
+
+    if (opts.async && received) return {202, true, job->id, 0, ""};
+    const auto admitted = ServerTiming::Clock::now();
+    bool printed = done.get();
+    timePrinted(*job, admitted);
+    return {200, printed && received, job->id, 0, ""};
+}
+
+json parseBody(const httplib::Request& req) {
+    TraceSpan span("http", "parse json");
+    AllocStage stage(AllocStageId::Parse);
+    TimingScope timing("parse");
+    return json::parse(req.body);
+}
+
+std::shared_ptr<const std::vector<BYTE>> share(std::vector<BYTE> data) {
+    return std::make_shared<const std::vector<BYTE>>(std::move(data));
+}
 
-        data.insert(data.end(), ESC_CUT.begin(), ESC_CUT.end());
-        return sendRaw(data);
+// Ticket de texto: {"lines": [...]}
+std::vector<Segment> ticketSegments(const json& body) {
+    TraceSpan span("http", "encode");
+    AllocStage stage(AllocStageId::Encode);
+    TimingScope timing("encode");
+    HIVA_PROBE(encode_start, "ticket");
+    auto lines = body.at("lines").get<std::vector<std::string>>();
+    auto data = share(ESCPOSPrinter::encodeTicket(lines));
+    HIVA_PROBE(encode_end, "ticket", data->size());
+    return {{std::move(data), 1}};
+}
+
+// Etiquetas: {"codes": [...], "copies": n, "text": "..."}. Una sola copia
+// codificada; la impresora la repite `copies` veces
+std::vector<Segment> labelSegments(const json& body) {
+    TraceSpan span("http", "encode");
+    AllocStage stage(AllocStageId::Encode);
+    TimingScope timing("encode");
+    HIVA_PROBE(encode_start, "barcode");
+    auto codes = body.at("codes").get<std::vector<std::string>>();
+    int copies = 1;
+    if (body.contains("copies")) {
+        const json& c = body["copies"];
+        if (!c.is_number_integer() || c.get<int64_t>() < 1 || c.get<int64_t>() > STREAM_MAX_COPIES)
+            throw BadRequest("copies invalido: " + c.dump());
+        copies = c.get<int>();
     }
+    std::string text = body.value("text", "");
 
-    bool getIsOpen() const { return isOpen; }
-    std::string getPrinterName() const { return printerName; }
-};
+    std::vector<BYTE> head, tail;
+    ESCPOSPrinter::beginLabels(head);
+    ESCPOSPrinter::appendCut(tail);
+    auto labels = share(ESCPOSPrinter::encodeLabelSet(codes, text));
+    HIVA_PROBE(encode_end, "barcode", head.size() + labels->size() + tail.size());
+    return {
+        {share(std::move(head)), 1},
+        {std::move(labels), copies},
+        {share(std::move(tail)), 1},
+    };
+}
 
-// ============================================================================
-// API HTTP
-// ============================================================================
+// Long-polls y suscriptores SSE ocupan un hilo HTTP cada uno: se acotan
+// para que no dejen sin hilos a los pedidos de impresión
+const size_t HTTP_THREADS       = 64;
+const int    MAX_LONG_POLLS     = 32;
+const int    MAX_SUBSCRIBERS    = 16;
+const int64_t MAX_POLL_MS       = 60000;
+const auto   SSE_KEEPALIVE      = std::chrono::seconds(15);
+
+// Tope de resultados de /history y de trabajos por /history/reprint
+const size_t MAX_HISTORY_RESULTS = 1000;
+const size_t MAX_HISTORY_REPRINT = 100;
+
+// Una captura de /debug/trace ocupa un hilo HTTP mientras dura
+const int MAX_TRACE_SECONDS = 60;
+
+// Asignaciones del hilo al empezar el pedido en curso (con HIVA_TRACK_ALLOCS)
+thread_local AllocTracker::Counts requestAllocs;
+
+std::atomic<int> longPolls{0};
+std::atomic<int> subscribers{0};
 
-ESCPOSPrinter printer;
+json statusJson(uint64_t id, const JobTracker::Status& st) {
+    json j;
+    j["job_id"]     = id;
+    j["state"]      = jobStateName(st.state);
+    j["updated_at"] = st.updatedAt;
+    if (!st.printer.empty()) j["printer"] = st.printer;
+    if (isTerminal(st.state)) j["success"] = st.state == JobState::Printed;
+    return j;
+}
+
+uint64_t jobIdParam(const httplib::Request& req) {
+    const std::string& s = req.path_params.at("id");
+    if (s.empty() || s.size() > 19 || s.find_first_not_of("0123456789") != std::string::npos)
+        throw BadRequest("id de trabajo invalido: " + s);
+    return std::stoull(s);
+}
+
+void sendOutcome(httplib::Response& res, const PrintOutcome& o) {
+    json j;
+    j["success"] = o.success;
+    if (o.jobId) j["job_id"] = o.jobId;
+    if (o.fireAt) j["fire_at"] = o.fireAt;
+    if (!o.error.empty()) j["error"] = o.error;
+    if (o.retryAfter) {
+        j["retry_after"] = o.retryAfter;
+        res.set_header("Retry-After", std::to_string(o.retryAfter));
+    }
+    res.status = o.status;
+    res.set_header("Server-Timing", ServerTiming::current().header(o.jobId));
+    res.set_content(j.dump(), "application/json");
+}
+
+// Ejecuta `job` una sola vez por Idempotency-Key. Si el POS reintenta con la
+// misma clave, se devuelve el resultado original sin codificar ni reenviar.
+template <typename Job>
+PrintOutcome runIdempotent(const httplib::Request& req, httplib::Response& res, Job&& job) {
+    std::string key = req.get_header_value("Idempotency-Key");
+    if (key.empty()) return job();
+
+    DedupCache::Ticket ticket;
+    DedupCache::Result result;
+    switch (dedup.acquire(req.path + "\n" + key, ticket, result)) {
+        case DedupCache::Claim::Duplicate:
+            res.set_header("Idempotent-Replayed", "true");
+            return {200, result.success, result.jobId, 0, ""};
+        case DedupCache::Claim::Full:
+            return job();
+        case DedupCache::Claim::Owner:
+            break;
+    }
+
+    // Los errores (y los rechazos por cola llena) no se cachean:
+    // el reintento vuelve a intentar imprimir
+    PrintOutcome out;
+    try {
+        out = job();
+    } catch (...) {
+        dedup.release(ticket);
+        throw;
+    }
+
+    if (out.success) dedup.complete(ticket, {true, out.jobId});
+    else             dedup.release(ticket);
+    return out;
+}
 
 int main() {
+#ifdef _WIN32
     // Consola limpia sin caracteres raros
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
+#endif
+
+    AgentConfig config = loadConfig("printagent.json");
+    ::Logger::configure(config.log);
+    spooler = std::make_unique<Spooler>(config);
+    scheduler = std::make_unique<Scheduler>(*spooler, config.scheduledLimits);
+    prepared  = std::make_unique<PreparedStore>(spooler->getTimers(), spooler->getTracker(),
+                                                config.preparedLimits);
 
     using namespace httplib;
     Server svr;
+    svr.new_task_queue = [] { return new ThreadPool(HTTP_THREADS); };
+    // Con keep-alive, Nagle retiene la respuesta hasta el ACK diferido (~40 ms)
+    svr.set_tcp_nodelay(true);
 
     // CORS
     svr.set_pre_routing_handler([](const Request& req, Response& res) {
+        ServerTiming::current().start();
+        HIVA_PROBE(http_request, req.method.c_str(), req.path.c_str(), req.body.size());
+        if constexpr (AllocTracker::enabled) {
+            AllocTracker::setStage(AllocStageId::Http);
+            requestAllocs = AllocTracker::threadCounts();
+        }
+
         res.set_header("Access-Control-Allow-Origin", "*");
-        res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        res.set_header("Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, Idempotency-Key, X-Client-Id");
+        res.set_header("Access-Control-Expose-Headers", "Idempotent-Replayed, Retry-After");
+        res.set_header("Timing-Allow-Origin", "*");
 
         if (req.method == "OPTIONS") {
             res.status = 204;
@@ -185,12 +534,40 @@ int main() {
         return Server::HandlerResponse::Unhandled;
     });
 
+    // Asignaciones de cada pedido por ruta, hasta antes de mandar la respuesta
+    svr.set_post_routing_handler([](const Request& req, Response&) {
+        if constexpr (AllocTracker::enabled)
+            AllocTracker::requestDone(req.method, req.matched_route, requestAllocs);
+    });
+
+    // Pedidos mal formados: 400 con el motivo en vez de un 500 genérico
+    svr.set_exception_handler([](const Request&, Response& res, std::exception_ptr ep) {
+        json j;
+        j["success"] = false;
+        try {
+            std::rethrow_exception(ep);
+        } catch (const BadRequest& e) {
+            res.status = 400;
+            j["error"] = e.what();
+        } catch (const json::exception& e) {
+            res.status = 400;
+            j["error"] = e.what();
+        } catch (const std::exception& e) {
+            res.status = 500;
+            j["error"] = e.what();
+        } catch (...) {
+            res.status = 500;
+        }
+        res.set_content(j.dump(), "application/json");
+    });
+
     // Health check
     svr.Get("/ping", [](const Request&, Response& res) {
+        auto st = spooler->resolve("")->snapshot();
         json j;
         j["service"] = "HIVA PrintAgent";
-        j["printer"] = printer.getPrinterName();
-        j["status"]  = printer.getIsOpen() ? "online" : "no_printer";
+        j["printer"] = st.device;
+        j["status"]  = st.online ? "online" : "no_printer";
         res.set_content(j.dump(), "application/json");
     });
 
@@ -201,37 +578,526 @@ int main() {
         res.set_content(j.dump(), "application/json");
     });
 
+    // Estado de las colas y velocidad de vaciado medida
+    svr.Get("/metrics", [](const Request&, Response& res) {
+        json j;
+        for (auto& [name, q] : spooler->getQueues()) {
+            auto st = q->snapshot();
+            j["printers"][name] = {
+                {"device",              st.device},
+                {"online",              st.online},
+                {"queued_jobs",         st.queuedJobs},
+                {"queued_bytes",        st.queuedBytes},
+                {"max_jobs",            q->getLimits().maxJobs},
+                {"max_bytes",           q->getLimits().maxBytes},
+                {"completed",           st.completed},
+                {"failed",              st.failed},
+                {"rejected",            st.rejected},
+                {"drain_bytes_per_sec", st.rate.bytesPerSec},
+                {"drain_jobs_per_sec",  st.rate.jobsPerSec},
+                {"preemptions",         st.preemptions},
+                {"batches",             st.batches},
+                {"coalesced_jobs",      st.coalesced},
+                {"coalesce_window_us",  st.coalesceWindowUs},
+                {"breaker",             CircuitBreaker::stateName(q->getBreaker().getState())},
+                {"breaker_opens",       q->getBreaker().getOpenCount()},
+                {"failovers",           st.failovers},
+                {"watchdog_resets",     st.watchdogResets},
+                {"cancelled",           st.cancelled},
+                {"aborted_uploads",     st.abortedUploads},
+            };
+            for (int p = 0; p < PRIORITY_COUNT; p++) {
+                const LatencyHistogram& w = st.wait[p];
+                j["printers"][name]["wait_ms"][priorityName((Priority)p)] = {
+                    {"count", w.count()},
+                    {"mean",  w.mean() / 1000.0},
+                    {"p50",   w.percentile(50) / 1000.0},
+                    {"p95",   w.percentile(95) / 1000.0},
+                    {"p99",   w.percentile(99) / 1000.0},
+                    {"max",   w.max() / 1000.0},
+                };
+            }
+            json clients = json::object();
+            for (auto& [client, cs] : st.clients) {
+                clients[client] = {
+                    {"weight",       spooler->getClients().weightOf(client)},
+                    {"queued_jobs",  cs.queuedJobs},
+                    {"queued_bytes", cs.queuedBytes},
+                    {"completed",    cs.completed},
+                    {"rejected",     cs.rejected},
+                };
+            }
+            j["printers"][name]["clients"] = clients;
+        }
+        for (auto& [name, pool] : spooler->getPools()) {
+            json members = json::array();
+            for (PrintQueue* q : pool->getMembers()) {
+                members.push_back({
+                    {"printer",        q->getName()},
+                    {"healthy",        q->healthy()},
+                    {"est_drain_sec",  q->estimatedDrainSec()},
+                });
+            }
+            j["pools"][name] = {
+                {"members",       members},
+                {"sticky_groups", pool->stickyGroups()},
+            };
+        }
+        auto& budget = spooler->getBudget();
+        j["agent"] = {
+            {"queued_jobs",  budget.queuedJobs()},
+            {"queued_bytes", budget.bytes()},
+            {"max_jobs",     budget.getLimits().maxJobs},
+            {"max_bytes",    budget.getLimits().maxBytes},
+        };
+        j["scheduled"] = {
+            {"pending_jobs",  scheduler->pendingJobs()},
+            {"pending_bytes", scheduler->bytes()},
+            {"fired",         scheduler->firedJobs()},
+            {"max_jobs",      scheduler->getLimits().maxJobs},
+            {"max_bytes",     scheduler->getLimits().maxBytes},
+        };
+        j["prepared"] = {
+            {"held_jobs",  prepared->size()},
+            {"held_bytes", prepared->bytes()},
+            {"expired",    prepared->expiredJobs()},
+            {"max_jobs",   prepared->getLimits().maxJobs},
+            {"max_bytes",  prepared->getLimits().maxBytes},
+        };
+        auto hs = spooler->getHistory().stats();
+        j["history"] = {
+            {"jobs",          hs.jobs},
+            {"file_bytes",    hs.fileBytes},
+            {"terms",         hs.terms},
+            {"dictionaries",  hs.dicts},
+            {"dropped",       hs.dropped},
+            {"compression",   hs.rawBytes ? (double)hs.storedBytes / hs.rawBytes : 0.0},
+        };
+        j["flight_recorder"] = {
+            {"jobs",           spooler->getRecorder().size()},
+            {"capacity_bytes", spooler->getRecorder().capacityBytes()},
+        };
+        j["log"] = {{"dropped", ::Logger::dropped()}};
+        res.set_content(j.dump(), "application/json");
+    });
+
     // Ticket
     svr.Post("/print/ticket", [](const Request& req, Response& res) {
-        auto body = json::parse(req.body);
-        auto lines = body["lines"].get<std::vector<std::string>>();
-        bool ok = printer.printTicket(lines);
-        res.set_content(ok ? "{\"success\":true}" : "{\"success\":false}", "application/json");
+        TraceSpan span("http", "POST /print/ticket");
+        PrintOutcome out = runIdempotent(req, res, [&] {
+            auto body = parseBody(req);
+            return printSegments(optionsFrom(req, body, Priority::Normal), ticketSegments(body));
+        });
+        span.job(out.jobId);
+        sendOutcome(res, out);
     });
 
     // Barcode
     svr.Post("/print/barcode", [](const Request& req, Response& res) {
+        TraceSpan span("http", "POST /print/barcode");
+        PrintOutcome out = runIdempotent(req, res, [&] {
+            auto body = parseBody(req);
+            return printSegments(optionsFrom(req, body, Priority::Bulk), labelSegments(body));
+        });
+        span.job(out.jobId);
+        sendOutcome(res, out);
+    });
+
+    // Preparación: codifica y guarda el trabajo sin imprimirlo
+    // {"type": "ticket"|"barcode", ...campos del endpoint..., "ttl_ms": 600000}
+    svr.Post("/jobs/prepare", [&config](const Request& req, Response& res) {
         auto body = json::parse(req.body);
-        auto codes = body["codes"].get<std::vector<std::string>>();
-        int copies = body.value("copies", 1);
-        std::string text = body.value("text", "");
-        bool ok = printer.printBarcode(codes, copies, text);
-        res.set_content(ok ? "{\"success\":true}" : "{\"success\":false}", "application/json");
+        std::string type = body.value("type", "ticket");
+        if (type != "ticket" && type != "barcode") throw BadRequest("tipo invalido: " + type);
+
+        bool ticket = type == "ticket";
+        JobOptions opts = optionsFrom(req, body, ticket ? Priority::Normal : Priority::Bulk);
+        if (opts.scheduled) throw BadRequest("fire_at/delay_ms van en el commit");
+
+        PreparedStore::Prepared p;
+        p.job = spooler->makeJob(ticket ? ticketSegments(body) : labelSegments(body));
+        p.job->priority = opts.priority;
+        p.job->ticket   = opts.ticket;
+        p.printer = opts.printer;
+        p.group   = opts.group;
+
+        auto ttl = std::chrono::milliseconds(std::clamp<int64_t>(
+            body.value("ttl_ms", (int64_t)config.preparedTtlMs), 1000, config.preparedTtlMs));
+        size_t bytes = p.job->queuedSize();
+        uint64_t id = p.job->id;
+        if (!prepared->put(std::move(p), ttl)) {
+            sendOutcome(res, {503, false, 0, 5, "demasiados trabajos preparados"});
+            return;
+        }
+
+        json j;
+        j["success"]       = true;
+        j["job_id"]        = id;
+        j["bytes"]         = bytes;
+        j["expires_in_ms"] = ttl.count();
+        res.set_content(j.dump(), "application/json");
+    });
+
+    // Confirmación: sólo encola lo ya codificado. El cuerpo (opcional)
+    // puede cambiar printer, group, priority o programarlo con fire_at/delay_ms.
+    svr.Post("/jobs/:id/commit", [](const Request& req, Response& res) {
+        sendOutcome(res, runIdempotent(req, res, [&] {
+            uint64_t id = jobIdParam(req);
+            json body = req.body.empty() ? json::object() : json::parse(req.body);
+
+            // Las opciones se validan antes de sacarlo: un 400 lo deja preparado
+            JobOptions opts = optionsFrom(req, body, Priority::Normal);
+
+            PreparedStore::Prepared p;
+            if (!prepared->take(id, p))
+                return PrintOutcome{404, false, 0, 0, "trabajo no preparado o vencido"};
+
+            if (body.value("priority", "").empty()) opts.priority = p.job->priority;
+            if (!body.contains("printer")) opts.printer = p.printer;
+            if (!body.contains("group"))   opts.group   = p.group;
+            if (!body.contains("ticket_id")) opts.ticket = p.job->ticket;
+
+            // Rechazado antes de encolarse (cola llena, impresora desconocida):
+            // vuelve a quedar preparado para reintentar el commit
+            PrintOutcome out = submitJob(opts, p.job);
+            if (!out.jobId && !prepared->restore(std::move(p))) {
+                LOG_WARN("Trabajo preparado {} descartado: no hubo lugar para volver a guardarlo", id);
+                out.error += "; trabajo preparado descartado (sin lugar para reintentar)";
+            }
+            return out;
+        }));
+    });
+
+    // Estado de un trabajo. Long-poll: ?wait_ms=30000 espera un estado final,
+    // o un cambio respecto de ?state=<último visto>
+    svr.Get("/jobs/:id", [](const Request& req, Response& res) {
+        uint64_t id = jobIdParam(req);
+        int64_t waitMs = 0;
+        if (req.has_param("wait_ms")) waitMs = intParam("wait_ms", req.get_param_value("wait_ms"), 0, MAX_POLL_MS);
+
+        JobState seen;
+        bool hasSeen = req.has_param("state");
+        if (hasSeen && !parseJobState(req.get_param_value("state"), seen))
+            throw BadRequest("estado invalido: " + req.get_param_value("state"));
+
+        JobTracker& tracker = spooler->getTracker();
+        JobTracker::Status st;
+        bool found;
+        // Sin lugar para otro long-poll se responde el estado actual
+        if (waitMs > 0 && ++longPolls <= MAX_LONG_POLLS)
+            found = tracker.waitChange(id, hasSeen ? &seen : nullptr, std::chrono::milliseconds(waitMs), st);
+        else
+            found = tracker.status(id, st);
+        if (waitMs > 0) longPolls--;
+
+        if (!found) {
+            sendOutcome(res, {404, false, 0, 0, "trabajo desconocido"});
+            return;
+        }
+        res.set_content(statusJson(id, st).dump(), "application/json");
+    });
+
+    // Cancelación: en cola, programado o preparado se descarta; un masivo o
+    // streaming en curso se corta en el próximo límite seguro (202)
+    svr.Delete("/jobs/:id", [](const Request& req, Response& res) {
+        uint64_t id = jobIdParam(req);
+        json j;
+        j["job_id"] = id;
+
+        if (scheduler->cancel(id) || prepared->discard(id)) {
+            j["success"] = true;
+            j["state"]   = "cancelled";
+            res.set_content(j.dump(), "application/json");
+            return;
+        }
+
+        JobTracker::Status st;
+        if (!spooler->getTracker().status(id, st)) {
+            sendOutcome(res, {404, false, 0, 0, "trabajo desconocido"});
+            return;
+        }
+
+        PrintQueue* queue = spooler->find(st.printer);
+        auto result = queue ? queue->cancel(id) : PrintQueue::CancelResult::NotFound;
+        switch (result) {
+            case PrintQueue::CancelResult::Cancelled:
+                j["state"] = "cancelled";
+                break;
+            case PrintQueue::CancelResult::Stopping:
+                res.status = 202;
+                j["state"] = "cancelling";
+                break;
+            default:
+                res.status = 409;
+                j["state"] = jobStateName(st.state);
+                j["error"] = isTerminal(st.state) ? "el trabajo ya termino"
+                           : result == PrintQueue::CancelResult::TooLate ? "ya se esta imprimiendo"
+                           : "no se puede cancelar en este estado";
+                break;
+        }
+        j["success"] = res.status != 409;
+        res.set_content(j.dump(), "application/json");
+    });
+
+    // Pasa un trabajo en cola al frente de su impresora
+    svr.Post("/jobs/:id/front", [](const Request& req, Response& res) {
+        uint64_t id = jobIdParam(req);
+        JobTracker::Status st;
+        if (!spooler->getTracker().status(id, st)) {
+            sendOutcome(res, {404, false, 0, 0, "trabajo desconocido"});
+            return;
+        }
+        PrintQueue* queue = spooler->find(st.printer);
+        if (!queue || !queue->moveToFront(id)) {
+            sendOutcome(res, {409, false, id, 0, "el trabajo no esta en cola"});
+            return;
+        }
+        sendOutcome(res, {200, true, id, 0, ""});
+    });
+
+    // Reimpresión: vuelve a mandar los bytes grabados del trabajo, sin
+    // codificar nada. Por defecto a la misma impresora; el cuerpo (opcional)
+    // puede cambiar printer, group, priority o async. Es un trabajo nuevo.
+    // Busca primero en el anillo de recientes y después en el historial.
+    svr.Post("/jobs/:id/reprint", [](const Request& req, Response& res) {
+        sendOutcome(res, runIdempotent(req, res, [&] {
+            uint64_t id = jobIdParam(req);
+            json body = req.body.empty() ? json::object() : json::parse(req.body);
+
+            std::string printer, ticket;
+            std::vector<Segment> segments;
+            FlightRecorder::Record recent;
+            HistoryStore::Record old;
+            if (spooler->getRecorder().find(id, recent)) {
+                printer  = recent.meta.printer;
+                ticket   = recent.meta.ticket;
+                segments = std::move(recent.segments);
+            } else if (spooler->getHistory().find(id, old)) {
+                printer  = old.meta.printer;
+                ticket   = old.meta.ticket;
+                segments = std::move(old.segments);
+            } else {
+                return PrintOutcome{404, false, 0, 0, "trabajo fuera del historial de reimpresion"};
+            }
+
+            JobOptions opts = optionsFrom(req, body, Priority::Normal);
+            if (!body.contains("printer"))   opts.printer = printer;
+            if (!body.contains("ticket_id")) opts.ticket  = ticket;
+            return submitJob(opts, spooler->makeJob(std::move(segments)));
+        }));
+    });
+
+    // Historial de lo impreso: /history?table=12&since=20:00 (más recientes
+    // primero). Con text=1 incluye el texto de cada trabajo.
+    svr.Get("/history", [](const Request& req, Response& res) {
+        auto t0 = std::chrono::steady_clock::now();
+        const HistoryStore& history = spooler->getHistory();
+        auto hits = history.search(historyQuery(req, MAX_HISTORY_RESULTS));
+        auto took = std::chrono::steady_clock::now() - t0;
+
+        const bool withText = req.get_param_value("text") == "1";
+        json jobs = json::array();
+        for (auto& h : hits) {
+            json j = {{"job_id", h.jobId}, {"ts", h.time}, {"printer", h.printer}, {"bytes", h.bytes}};
+            if (!h.ticket.empty()) j["ticket_id"] = h.ticket;
+            std::string text;
+            if (withText && history.text(h.jobId, text)) j["text"] = text;
+            jobs.push_back(j);
+        }
+        json j = {{"jobs", jobs},
+                  {"search_us", std::chrono::duration_cast<std::chrono::microseconds>(took).count()}};
+        res.set_content(j.dump(), "application/json");
+    });
+
+    // Reimprime todo lo que coincide con los filtros de /history, del más
+    // viejo al más nuevo ("todo lo de la mesa 12 desde las 20:00"). El
+    // cuerpo (opcional) puede mandar todo a otra impresora con "printer".
+    // Exige algún filtro o since: sin ellos reimprimiría lo último de todo.
+    // Con Idempotency-Key un reintento no vuelve a reimprimir la tanda; se
+    // cachea en cuanto salió algún trabajo (el job_id es el primero).
+    svr.Post("/history/reprint", [](const Request& req, Response& res) {
+        json body = req.body.empty() ? json::object() : json::parse(req.body);
+        auto query = historyQuery(req, MAX_HISTORY_REPRINT);
+        if (query.terms.empty() && !req.has_param("since"))
+            throw BadRequest("reprint necesita al menos un filtro o since");
+
+        json reprinted = json::array();
+        size_t failed = 0;
+        PrintOutcome out = runIdempotent(req, res, [&] {
+            PrintOutcome first;
+            auto hits = spooler->getHistory().search(query);
+            for (auto it = hits.rbegin(); it != hits.rend(); ++it) {
+                HistoryStore::Record rec;
+                if (!spooler->getHistory().find(it->jobId, rec)) {
+                    failed++;
+                    continue;
+                }
+                JobOptions opts = optionsFrom(req, body, Priority::Normal);
+                if (!body.contains("printer")) opts.printer = rec.meta.printer;
+                opts.ticket = rec.meta.ticket;
+                opts.async  = true;
+                PrintOutcome one = submitJob(opts, spooler->makeJob(std::move(rec.segments)));
+                if (!one.jobId) {
+                    failed++;
+                    continue;
+                }
+                reprinted.push_back({{"job_id", one.jobId}, {"reprint_of", it->jobId}});
+                if (!first.jobId) first = one;
+            }
+            first.success = first.jobId != 0;
+            return first;
+        });
+
+        json j = {{"success", failed == 0}, {"reprinted", reprinted}, {"failed", failed}};
+        if (res.has_header("Idempotent-Replayed")) j = {{"success", out.success}, {"job_id", out.jobId}};
+        res.set_content(j.dump(), "application/json");
+    });
+
+    // Últimos trabajos grabados, para encontrar el id de una comanda
+    // perdida: /flight?limit=50&ticket_id=A-1024
+    svr.Get("/flight", [](const Request& req, Response& res) {
+        int64_t limit = 50;
+        if (req.has_param("limit"))
+            limit = intParam("limit", req.get_param_value("limit"), 1, std::numeric_limits<int64_t>::max());
+        json jobs = json::array();
+        for (auto& m : spooler->getRecorder().recent((size_t)std::min<int64_t>(limit, 1000),
+                                                     req.get_param_value("ticket_id"))) {
+            json j = {{"job_id", m.jobId}, {"ts", m.time}, {"printer", m.printer},
+                      {"source", m.source}, {"bytes", m.bytes}};
+            if (!m.ticket.empty()) j["ticket_id"] = m.ticket;
+            jobs.push_back(j);
+        }
+        res.set_content(json{{"jobs", jobs}}.dump(), "application/json");
+    });
+
+    // Línea de tiempo de los próximos N segundos en formato Chrome trace:
+    // /debug/trace?seconds=5 > trace.json y se abre en ui.perfetto.dev
+    svr.Get("/debug/trace", [](const Request& req, Response& res) {
+        int seconds = 5;
+        if (req.has_param("seconds"))
+            seconds = (int)intParam("seconds", req.get_param_value("seconds"), 1, MAX_TRACE_SECONDS);
+
+        json trace;
+        if (!Tracer::capture(std::chrono::seconds(seconds), trace)) {
+            res.status = 409;
+            res.set_content(json{{"success", false}, {"error", "ya hay una captura en curso"}}.dump(),
+                            "application/json");
+            return;
+        }
+        res.set_header("Content-Disposition", "attachment; filename=\"printagent-trace.json\"");
+        res.set_content(trace.dump(), "application/json");
+    });
+
+    // Asignaciones de memoria por etapa y por ruta; sólo en un build con
+    // -DHIVA_TRACK_ALLOCS (si no, {"enabled": false})
+    svr.Get("/debug/allocs", [](const Request&, Response& res) {
+        res.set_content(AllocTracker::snapshot().dump(), "application/json");
+    });
+
+    // Eventos de todos los trabajos (Server-Sent Events). Last-Event-ID
+    // retoma desde el último evento recibido si sigue en el anillo.
+    svr.Get("/events", [](const Request& req, Response& res) {
+        if (++subscribers > MAX_SUBSCRIBERS) {
+            subscribers--;
+            sendOutcome(res, {503, false, 0, 5, "demasiados suscriptores"});
+            return;
+        }
+
+        JobTracker& tracker = spooler->getTracker();
+        auto cursor = std::make_shared<uint64_t>(tracker.head());
+        std::string last = req.get_header_value("Last-Event-ID");
+        if (!last.empty() && last.find_first_not_of("0123456789") == std::string::npos && last.size() < 20)
+            *cursor = std::stoull(last) + 1;
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [cursor, &tracker](size_t, DataSink& sink) {
+                std::vector<JobTracker::Frame> frames;
+                bool lost = false;
+                tracker.read(*cursor, SSE_KEEPALIVE, frames, lost);
+                if (tracker.isStopping() || !sink.is_writable()) return false;
+
+                static const std::string LOST = "event: lost\ndata: {}\n\n";
+                static const std::string PING = ": ping\n\n";
+                if (lost && !sink.write(LOST.data(), LOST.size())) return false;
+                if (frames.empty()) return sink.write(PING.data(), PING.size());
+                for (auto& f : frames)
+                    if (!sink.write(f->data(), f->size())) return false;
+                return true;
+            },
+            [](bool) { subscribers--; });
+    });
+
+    // Ticket en streaming: /print/ticket/stream?printer=cocina
+    svr.Post("/print/ticket/stream", [](const Request& req, Response& res,
+                                        const ContentReader& reader) {
+        sendOutcome(res, runIdempotent(req, res, [&] {
+            std::vector<BYTE> head, tail;
+            ESCPOSPrinter::beginTicket(head);
+            ESCPOSPrinter::appendCut(tail);
+            return printStream(optionsFrom(req, Priority::Bulk), reader, head,
+                [](ChunkWriter& out, const std::string& line) {
+                    ESCPOSPrinter::appendLine(out.buf(), line);
+                    return out.flushFull();
+                }, tail);
+        }));
+    });
+
+    // Etiquetas en streaming: /print/barcode/stream?copies=2&text=...
+    // Con cuerpo en streaming las copias se aplican a cada código; cada
+    // copia sale como su propia unidad, sin armar todas en memoria.
+    svr.Post("/print/barcode/stream", [](const Request& req, Response& res,
+                                         const ContentReader& reader) {
+        sendOutcome(res, runIdempotent(req, res, [&] {
+            int copies = req.has_param("copies")
+                ? (int)intParam("copies", req.get_param_value("copies"), 1, STREAM_MAX_COPIES) : 1;
+            std::string text = req.get_param_value("text");
+
+            std::vector<BYTE> head, tail;
+            ESCPOSPrinter::beginLabels(head);
+            ESCPOSPrinter::appendCut(tail);
+            return printStream(optionsFrom(req, Priority::Bulk), reader, head,
+                [copies, text](ChunkWriter& out, const std::string& code) {
+                    for (int c = 0; c < copies; c++) {
+                        if (!text.empty()) ESCPOSPrinter::appendLine(out.buf(), text);
+                        ESCPOSPrinter::appendBarcode(out.buf(), code);
+                        if (!out.flushFull()) return false;
+                    }
+                    return true;
+                }, tail);
+        }));
     });
 
     // Banner profesional limpio
-    std::cout << "-----------------------------------------------\n";
-    std::cout << " HIVA Sistemas de Impresion - PrintAgent v1.0\n";
-    std::cout << " Servicio local de impresion ESC/POS\n";
-    std::cout << "-----------------------------------------------\n";
+    LOG_INFO("-----------------------------------------------");
+    LOG_INFO(" HIVA Sistemas de Impresion - PrintAgent v1.0");
+    LOG_INFO(" Servicio local de impresion ESC/POS");
+    LOG_INFO("-----------------------------------------------");
 
-    if (printer.open())
-        std::cout << " Impresora activa: " << printer.getPrinterName() << "\n";
-    else
-        std::cout << " Sin impresora disponible\n";
+    for (auto& [name, q] : spooler->getQueues()) {
+        if (q->open())
+            LOG_INFO(" Impresora activa: {} -> {}", name, q->snapshot().device);
+        else
+            LOG_WARN(" Sin impresora disponible: {}", name);
+    }
+
+    spooler->start();
+
+    // Puertos RAW (9100) para POS que sólo imprimen a impresoras de red
+    std::vector<std::unique_ptr<RawIngress>> rawPorts;
+    for (auto& [port, name] : config.rawPorts) {
+        auto raw = std::make_unique<RawIngress>(*spooler, name, port, config.rawIdleMs);
+        if (raw->start()) {
+            LOG_INFO(" Puerto RAW {} -> {}", port, name);
+            rawPorts.push_back(std::move(raw));
+        }
+    }
 
-    std::cout << " MANTENE LA ABIERTA LA VENTANA";
+    LOG_INFO(" MANTENE LA ABIERTA LA VENTANA");
 
     svr.listen("0.0.0.0", 9999);
+    rawPorts.clear();
+    spooler->stop();
+    ::Logger::shutdown();
     return 0;
 }
@@ -0,0 +1,369 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// printagent-loadgen - Generador de carga para la API de impresión
+// ============================================================================
+//
+// Manda una mezcla de comandas (/print/ticket), etiquetas (/print/barcode)
+// y tandas masivas de etiquetas (bulk) contra un agente y reporta
+// throughput y percentiles de latencia por tipo.
+//
+//   Lazo abierto (--mode open --rate 200): los pedidos tienen una hora de
+//   llegada fija (k / rate) y la latencia se mide desde esa hora, no desde
+//   que una conexión quedó libre. Si el agente se atrasa, la espera cuenta:
+//   sin esto (coordinated omission) un agente trabado parece rápido.
+//
+//   Lazo cerrado (--mode closed): cada conexión manda el siguiente pedido
+//   apenas recibe la respuesta; mide el máximo sostenido con N conexiones.
+//
+// Para medir al agente y no al papel, correrlo con la impresora nula o
+// simulada.
+//
+// Con --allocs (agente compilado con PRINTAGENT_TRACK_ALLOCS) lee
+// /debug/allocs antes y después y reporta asignaciones por pedido, por
+// ruta y por etapa.
+//
+// Ejemplo:
+//   printagent-loadgen --mode open --rate 500 --connections 64 --duration 30
+//                      --mix ticket=80,barcode=15,batch=5 --printer cocina
+
+#include "httplib.h"
+#include "json.hpp"
+#include "latency_histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+enum Kind { TICKET, BARCODE, BATCH, KINDS };
+const char* KIND_NAMES[KINDS] = {"ticket", "barcode", "batch"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 9999;
+    bool open = true;                   // lazo abierto
+    double rate = 100.0;                // pedidos/s (lazo abierto)
+    int connections = 16;
+    double duration = 10.0;             // segundos medidos
+    double warmup = 2.0;                // segundos que no se miden
+    int mix[KINDS] = {80, 15, 5};       // pesos de cada tipo
+    std::string printer;
+    int clients = 0;                    // X-Client-Id distintos (0 = uno por conexión)
+    bool async = false;                 // responder al encolar
+    bool asJson = false;
+    bool allocs = false;                // asignaciones por pedido (/debug/allocs)
+};
+
+// Resultado de una conexión; se suman al final
+struct Tally {
+    LatencyHistogram latency[KINDS];
+    uint64_t ok[KINDS] = {};
+    std::map<int, uint64_t> errors;     // status HTTP (0 = error de conexión)
+    uint64_t maxLagUs = 0;              // atraso máximo al mandar (lazo abierto)
+};
+
+const char* DISHES[] = {
+    "Milanesa napolitana", "Bife de chorizo", "Papas fritas", "Ensalada mixta",
+    "Coca-Cola 500", "Agua sin gas", "Flan con dulce", "Pizza muzzarella",
+    "Empanada de carne", "Cerveza IPA", "Ravioles con tuco", "Sorrentinos",
+    "Tiramisu", "Cafe cortado", "Provoleta",
+};
+const char* NOTES[] = {"sin sal", "bien cocido", "sin hielo", "para compartir", "sin TACC"};
+
+std::string ticketBody(std::mt19937& rng, uint64_t seq, const Options& o) {
+    json lines = json::array();
+    lines.push_back("RESTO HIVA - Av. Siempreviva 742");
+    lines.push_back("Mesa " + std::to_string(rng() % 40 + 1) + "   Mozo: " + std::to_string(rng() % 8 + 1));
+    lines.push_back("Pedido #" + std::to_string(seq));
+    lines.push_back("--------------------------------");
+    const int items = (int)(rng() % 10) + 2;
+    for (int i = 0; i < items; i++) {
+        lines.push_back(std::to_string(rng() % 3 + 1) + "x " + DISHES[rng() % 15]);
+        if (rng() % 5 == 0) lines.push_back("   * " + std::string(NOTES[rng() % 5]));
+    }
+    lines.push_back("--------------------------------");
+    json body = {{"lines", lines}, {"ticket_id", "LG-" + std::to_string(seq)}};
+    if (!o.printer.empty()) body["printer"] = o.printer;
+    if (o.async) body["async"] = true;
+    return body.dump();
+}
+
+std::string code(std::mt19937& rng) {
+    std::string c = "779";
+    for (int i = 0; i < 10; i++) c += (char)('0' + rng() % 10);
+    return c;
+}
+
+// Etiquetas de góndola (pocas copias) o una tanda masiva (bulk)
+std::string barcodeBody(std::mt19937& rng, bool batch, const Options& o) {
+    json codes = json::array();
+    const int n = batch ? (int)(rng() % 2) + 1 : (int)(rng() % 4) + 1;
+    for (int i = 0; i < n; i++) codes.push_back(code(rng));
+    json body = {{"codes", codes},
+                 {"copies", batch ? (int)(rng() % 81) + 20 : (int)(rng() % 3) + 1},
+                 {"text", "Oferta $" + std::to_string(rng() % 9000 + 100)}};
+    if (batch) body["priority"] = "bulk";
+    if (!o.printer.empty()) body["printer"] = o.printer;
+    if (o.async) body["async"] = true;
+    return body.dump();
+}
+
+Kind pickKind(std::mt19937& rng, const Options& o) {
+    const int total = o.mix[TICKET] + o.mix[BARCODE] + o.mix[BATCH];
+    int r = (int)(rng() % (unsigned)total);
+    for (int k = 0; k < KINDS; k++) {
+        if (r < o.mix[k]) return (Kind)k;
+        r -= o.mix[k];
+    }
+    return TICKET;
+}
+
+void worker(int id, const Options& o, Clock::time_point t0, std::atomic<uint64_t>& next, Tally& tally) {
+    using namespace std::chrono;
+    httplib::Client cli(o.host, o.port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+    cli.set_read_timeout(60, 0);
+
+    const int clientNo = o.clients > 0 ? id % o.clients : id;
+    httplib::Headers headers = {{"X-Client-Id", "loadgen-" + std::to_string(clientNo)}};
+
+    std::mt19937 rng(1234u + (unsigned)id);
+    const auto measureFrom = t0 + duration_cast<Clock::duration>(duration<double>(o.warmup));
+    const auto end = measureFrom + duration_cast<Clock::duration>(duration<double>(o.duration));
+
+    for (;;) {
+        const uint64_t seq = next.fetch_add(1);
+        Clock::time_point intended;
+        if (o.open) {
+            intended = t0 + duration_cast<Clock::duration>(duration<double>(seq / o.rate));
+            if (intended >= end) return;
+            std::this_thread::sleep_until(intended);
+        } else {
+            intended = Clock::now();
+            if (intended >= end) return;
+        }
+        const auto sent = Clock::now();
+
+        const Kind kind = pickKind(rng, o);
+        const std::string body = kind == TICKET ? ticketBody(rng, seq, o) : barcodeBody(rng, kind == BATCH, o);
+        auto res = cli.Post(kind == TICKET ? "/print/ticket" : "/print/barcode", headers, body, "application/json");
+        const auto done = Clock::now();
+
+        if (intended < measureFrom) continue;
+        if (o.open) tally.maxLagUs = std::max<uint64_t>(tally.maxLagUs,
+            (uint64_t)duration_cast<microseconds>(sent - intended).count());
+
+        const int status = res ? res->status : 0;
+        if (status == 200 || status == 202) {
+            tally.ok[kind]++;
+            tally.latency[kind].record((uint64_t)duration_cast<microseconds>(done - intended).count());
+        } else {
+            tally.errors[status]++;
+        }
+    }
+}
+
+json percentiles(const LatencyHistogram& h) {
+    auto ms = [](uint64_t us) { return us / 1000.0; };
+    return {{"count", h.count()}, {"mean_ms", h.mean() / 1000.0}, {"p50_ms", ms(h.percentile(50))},
+            {"p90_ms", ms(h.percentile(90))}, {"p99_ms", ms(h.percentile(99))},
+            {"p999_ms", ms(h.percentile(99.9))}, {"max_ms", ms(h.max())}};
+}
+
+// /debug/allocs del agente; null si no responde o no cuenta asignaciones
+json fetchAllocs(const Options& o) {
+    httplib::Client cli(o.host, o.port);
+    auto res = cli.Get("/debug/allocs");
+    if (!res || res->status != 200) return nullptr;
+    json j = json::parse(res->body, nullptr, false);
+    return j.is_object() && j.value("enabled", false) ? j : json();
+}
+
+// Diferencia entre dos lecturas de /debug/allocs, por pedido
+json allocDelta(const json& before, const json& after) {
+    auto delta = [](const json& a, const json& b, const char* key) {
+        return b.value(key, (uint64_t)0) - a.value(key, (uint64_t)0);
+    };
+
+    json routes = json::object();
+    uint64_t requests = 0;
+    for (auto& [route, r] : after["routes"].items()) {
+        const json& r0 = before["routes"].contains(route) ? before["routes"][route] : json::object();
+        const uint64_t n = delta(r0, r, "requests");
+        if (route.rfind("POST /print/", 0) != 0 || n == 0) continue;
+        requests += n;
+        routes[route] = {{"requests", n},
+                         {"allocs_per_request", (double)delta(r0, r, "allocs") / n},
+                         {"bytes_per_request", (double)delta(r0, r, "bytes") / n}};
+    }
+
+    // Las etapas incluyen lo que pasa fuera del hilo HTTP (impresión,
+    // historial): se reparten entre todos los pedidos de impresión
+    json stages = json::object();
+    for (auto& [stage, s] : after["stages"].items()) {
+        const uint64_t allocs = delta(before["stages"][stage], s, "allocs");
+        if (!allocs || !requests) continue;
+        stages[stage] = {{"allocs_per_request", (double)allocs / requests},
+                         {"bytes_per_request", (double)delta(before["stages"][stage], s, "bytes") / requests}};
+    }
+    return {{"routes", routes}, {"stages", stages}, {"live_bytes", after["live_bytes"]}};
+}
+
+bool parseMix(const std::string& s, int mix[KINDS]) {
+    for (int k = 0; k < KINDS; k++) mix[k] = 0;
+    std::istringstream in(s);
+    std::string part;
+    while (std::getline(in, part, ',')) {
+        auto eq = part.find('=');
+        if (eq == std::string::npos) return false;
+        const std::string name = part.substr(0, eq);
+        int k = 0;
+        while (k < KINDS && name != KIND_NAMES[k]) k++;
+        if (k == KINDS) return false;
+        mix[k] = std::max(0, std::atoi(part.c_str() + eq + 1));
+    }
+    return mix[TICKET] + mix[BARCODE] + mix[BATCH] > 0;
+}
+
+void usage() {
+    std::fprintf(stderr,
+        "uso: printagent-loadgen [--host 127.0.0.1] [--port 9999] [--mode open|closed]\n"
+        "                        [--rate N] [--connections N] [--duration S] [--warmup S]\n"
+        "                        [--mix ticket=80,barcode=15,batch=5] [--printer NOMBRE]\n"
+        "                        [--clients N] [--async] [--allocs] [--json]\n");
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if      (a == "--host")        o.host = value();
+        else if (a == "--port")        o.port = std::atoi(value().c_str());
+        else if (a == "--mode") {
+            const std::string m = value();
+            if (m != "open" && m != "closed") return false;
+            o.open = m == "open";
+        }
+        else if (a == "--rate")        o.rate = std::atof(value().c_str());
+        else if (a == "--connections") o.connections = std::atoi(value().c_str());
+        else if (a == "--duration")    o.duration = std::atof(value().c_str());
+        else if (a == "--warmup")      o.warmup = std::atof(value().c_str());
+        else if (a == "--mix")       { if (!parseMix(value(), o.mix)) return false; }
+        else if (a == "--printer")     o.printer = value();
+        else if (a == "--clients")     o.clients = std::atoi(value().c_str());
+        else if (a == "--async")       o.async = true;
+        else if (a == "--allocs")      o.allocs = true;
+        else if (a == "--json")        o.asJson = true;
+        else return false;
+    }
+    return o.rate > 0 && o.connections > 0 && o.duration > 0 && o.warmup >= 0;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    if (!parseArgs(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+
+    json allocsBefore;
+    if (o.allocs) {
+        allocsBefore = fetchAllocs(o);
+        if (allocsBefore.is_null()) {
+            std::fprintf(stderr, "el agente no cuenta asignaciones (compilar con PRINTAGENT_TRACK_ALLOCS)\n");
+            return 2;
+        }
+    }
+
+    std::vector<Tally> tallies(o.connections);
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> next{0};
+    // Las conexiones arrancan juntas
+    const auto t0 = Clock::now() + std::chrono::milliseconds(100);
+    for (int i = 0; i < o.connections; i++)
+        threads.emplace_back(worker, i, std::cref(o), t0, std::ref(next), std::ref(tallies[i]));
+    for (auto& t : threads) t.join();
+
+    Tally total;
+    for (auto& t : tallies) {
+        for (int k = 0; k < KINDS; k++) {
+            total.latency[k].merge(t.latency[k]);
+            total.ok[k] += t.ok[k];
+        }
+        for (auto& [status, n] : t.errors) total.errors[status] += n;
+        total.maxLagUs = std::max(total.maxLagUs, t.maxLagUs);
+    }
+
+    LatencyHistogram all;
+    uint64_t ok = 0, failed = 0;
+    for (int k = 0; k < KINDS; k++) {
+        all.merge(total.latency[k]);
+        ok += total.ok[k];
+    }
+    for (auto& [status, n] : total.errors) failed += n;
+
+    json report;
+    report["mode"]        = o.open ? "open" : "closed";
+    report["connections"] = o.connections;
+    report["duration_s"]  = o.duration;
+    if (o.open) report["target_rate"] = o.rate;
+    report["throughput"]  = ok / o.duration;
+    report["ok"]          = ok;
+    report["failed"]      = failed;
+    report["all"]         = percentiles(all);
+    for (int k = 0; k < KINDS; k++)
+        if (total.ok[k]) report[KIND_NAMES[k]] = percentiles(total.latency[k]);
+    json errors = json::object();
+    for (auto& [status, n] : total.errors) errors[status ? std::to_string(status) : "connection"] = n;
+    report["errors"] = errors;
+    if (o.open) report["max_send_lag_ms"] = total.maxLagUs / 1000.0;
+    if (o.allocs) {
+        json after = fetchAllocs(o);
+        if (!after.is_null()) report["allocs"] = allocDelta(allocsBefore, after);
+    }
+
+    if (o.asJson) {
+        std::printf("%s\n", report.dump(2).c_str());
+        return failed ? 1 : 0;
+    }
+
+    std::printf("modo %s, %d conexiones, %.0f s", o.open ? "abierto" : "cerrado", o.connections, o.duration);
+    if (o.open) std::printf(", objetivo %.0f/s", o.rate);
+    std::printf("\nthroughput: %.1f pedidos/s (%llu ok, %llu con error)\n",
+                ok / o.duration, (unsigned long long)ok, (unsigned long long)failed);
+    std::printf("%-8s %8s %9s %9s %9s %9s %9s %9s\n", "", "n", "media", "p50", "p90", "p99", "p99.9", "max");
+    auto row = [](const char* name, const LatencyHistogram& h) {
+        if (!h.count()) return;
+        std::printf("%-8s %8llu %7.2fms %7.2fms %7.2fms %7.2fms %7.2fms %7.2fms\n", name,
+                    (unsigned long long)h.count(), h.mean() / 1000.0, h.percentile(50) / 1000.0,
+                    h.percentile(90) / 1000.0, h.percentile(99) / 1000.0, h.percentile(99.9) / 1000.0,
+                    h.max() / 1000.0);
+    };
+    for (int k = 0; k < KINDS; k++) row(KIND_NAMES[k], total.latency[k]);
+    row("total", all);
+    for (auto& [status, n] : total.errors)
+        std::printf("error %s: %llu\n", status ? std::to_string(status).c_str() : "de conexion",
+                    (unsigned long long)n);
+    if (o.open && total.maxLagUs > 100000)
+        std::printf("aviso: el generador se atraso %.0f ms; subir --connections\n", total.maxLagUs / 1000.0);
+    if (report.contains("allocs")) {
+        std::printf("\nasignaciones por pedido         allocs      bytes\n");
+        for (auto& [route, r] : report["allocs"]["routes"].items())
+            std::printf("%-28s %9.1f %10.0f\n", route.c_str(), r["allocs_per_request"].get<double>(),
+                        r["bytes_per_request"].get<double>());
+        for (auto& [stage, s] : report["allocs"]["stages"].items())
+            std::printf("  etapa %-20s %9.1f %10.0f\n", stage.c_str(), s["allocs_per_request"].get<double>(),
+                        s["bytes_per_request"].get<double>());
+    }
+    return failed ? 1 : 0;
+}
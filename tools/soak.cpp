@@ -0,0 +1,643 @@
+// ============================================================================
+// HIVA Sistemas de Impresión - PrintAgent
+// printagent-soak - Prueba de resistencia con verificación byte a byte
+// ============================================================================
+//
+// Muchos hilos mandan comandas (/print/ticket) y etiquetas (/print/barcode)
+// durante horas contra impresoras simuladas cuyo "sink" apunta a este
+// programa. Del lado que recibe se verifica cada trabajo contra los bytes
+// ESC/POS que le corresponden:
+//
+//   corrupto    no coincide byte a byte (intercalado con otro, cortado...)
+//   duplicado   llegó dos veces
+//   perdido     el agente respondió success y nunca llegó
+//   inesperado  llegó algo que no se mandó
+//
+// El contenido de cada trabajo sale de su número (semilla), así que no hace
+// falta guardarlo: la primera línea ("SOAK T 123" o el texto "SOAK B 123" de
+// las etiquetas) identifica al trabajo y se regenera lo esperado. Cada
+// --interval segundos se imprime throughput, latencia y memoria del agente
+// (live_bytes de /debug/allocs si está, RSS con --pid) para ver la deriva.
+//
+// Configuración del agente (sin macros: cambian los bytes):
+//   "printers": {
+//     "soak1": { "backend": "sim", "coalesce_max_us": 5000,
+//                "sim": { "mm_per_s": 0, "cut_ms": 0, "buffer_bytes": 65536,
+//                         "sink": "127.0.0.1:9300" } },
+//     "soak2": { ...igual... }
+//   }
+//
+// Ejemplo (4 horas):
+//   printagent-soak --threads 64 --duration 14400 --printers soak1,soak2
+//                   --pid $(pidof PrintAgent)
+
+#include "httplib.h"
+#include "json.hpp"
+#include "latency_histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 9999;
+    int threads = 32;
+    double duration = 3600.0;           // segundos
+    double interval = 60.0;             // cada cuánto se reporta
+    int sinkPort = 9300;
+    std::vector<std::string> printers;  // vacío = la impresora por omisión
+    int ticketWeight = 80;              // el resto, etiquetas
+    double grace = 30.0;                // espera final por lo que falta llegar
+    int pid = 0;                        // agente, para leer su RSS (Linux)
+    bool asJson = false;
+};
+
+// ---------------------------------------------------------------------------
+// Trabajos: contenido y bytes esperados a partir del número
+// ---------------------------------------------------------------------------
+
+const char* DISHES[] = {
+    "Milanesa napolitana", "Bife de chorizo", "Papas fritas", "Ensalada mixta",
+    "Coca-Cola 500", "Agua sin gas", "Flan con dulce", "Pizza muzzarella",
+    "Empanada de carne", "Cerveza IPA", "Ravioles con tuco", "Sorrentinos",
+};
+
+struct Job {
+    bool ticket;
+    std::string body;                   // JSON del pedido
+    std::string expected;               // ESC/POS que tiene que llegar
+};
+
+Job makeJob(uint64_t seq, const Options& o) {
+    std::mt19937_64 rng(seq * 0x9E3779B97F4A7C15ull + 1);
+    Job job;
+    job.ticket = (int)(rng() % 100) < o.ticketWeight;
+    json body;
+
+    if (job.ticket) {
+        std::vector<std::string> lines = {"SOAK T " + std::to_string(seq)};
+        const int items = (int)(rng() % 12) + 2;
+        for (int i = 0; i < items; i++)
+            lines.push_back(std::to_string(rng() % 3 + 1) + "x " + DISHES[rng() % 12]);
+        lines.push_back(std::string(rng() % 40, '-'));
+
+        job.expected = std::string("\x1B\x40\x1B\x61\x00", 5);
+        for (auto& l : lines) job.expected += l + "\n";
+        body["lines"] = lines;
+    } else {
+        const std::string text = "SOAK B " + std::to_string(seq);
+        std::vector<std::string> codes;
+        const int n = (int)(rng() % 3) + 1;
+        for (int i = 0; i < n; i++) {
+            std::string c;
+            for (int d = 0; d < 12; d++) c += (char)('0' + rng() % 10);    // CODE128 de 12
+            codes.push_back(c);
+        }
+        const int copies = (int)(rng() % 3) + 1;
+
+        std::string set = text + "\n";
+        for (auto& c : codes) set += std::string("\x1D\x6B\x43\x0C") + c + "\n";
+        job.expected = "\x1B\x40\x1B\x61\x01";
+        for (int i = 0; i < copies; i++) job.expected += set;
+        body["codes"] = codes;
+        body["copies"] = copies;
+        body["text"] = text;
+    }
+    job.expected += std::string("\x1D\x56\x00", 3);
+
+    if (!o.printers.empty()) body["printer"] = o.printers[seq % o.printers.size()];
+    job.body = body.dump();
+    return job;
+}
+
+// ---------------------------------------------------------------------------
+// Estado de cada número: mandado, confirmado, fallido, recibido
+// ---------------------------------------------------------------------------
+
+class Ledger {
+public:
+    enum : uint8_t { SENT = 1, ACKED = 2, FAILED = 4, RECEIVED = 8 };
+
+    ~Ledger() {
+        for (auto& c : chunks) delete[] c.load();
+    }
+
+    // Marca y devuelve lo que había; false si el número está fuera de rango
+    bool mark(uint64_t seq, uint8_t flag, uint8_t& before) {
+        std::atomic<uint8_t>* slot = at(seq);
+        if (!slot) return false;
+        before = slot->fetch_or(flag);
+        return true;
+    }
+
+    uint8_t get(uint64_t seq) {
+        std::atomic<uint8_t>* slot = at(seq);
+        return slot ? slot->load() : 0;
+    }
+
+private:
+    static constexpr uint64_t CHUNK  = 1 << 20;
+    static constexpr size_t   CHUNKS = 4096;   // 4 mil millones de trabajos
+
+    std::atomic<std::atomic<uint8_t>*> chunks[CHUNKS] = {};
+    std::mutex mtx;
+
+    std::atomic<uint8_t>* at(uint64_t seq) {
+        const uint64_t c = seq / CHUNK;
+        if (c >= CHUNKS) return nullptr;
+        std::atomic<uint8_t>* chunk = chunks[c].load(std::memory_order_acquire);
+        if (!chunk) {
+            std::lock_guard<std::mutex> lock(mtx);
+            chunk = chunks[c].load();
+            if (!chunk) {
+                chunk = new std::atomic<uint8_t>[CHUNK]();
+                chunks[c].store(chunk, std::memory_order_release);
+            }
+        }
+        return &chunk[seq % CHUNK];
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Lado que recibe: el sink de las impresoras simuladas
+// ---------------------------------------------------------------------------
+
+struct Verdicts {
+    std::atomic<uint64_t> docs{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> ok{0};
+    std::atomic<uint64_t> corrupt{0};
+    std::atomic<uint64_t> duplicate{0};
+    std::atomic<uint64_t> unexpected{0};
+    std::atomic<uint64_t> truncated{0};     // documentos cortados (conexión caída)
+    std::mutex mtx;
+    std::vector<std::string> samples;       // primeros problemas, para el reporte
+};
+
+class Sink {
+public:
+    Sink(const Options& o, Ledger& ledger, Verdicts& v) : o(o), ledger(ledger), v(v) {}
+
+    ~Sink() { stop(); }
+
+    bool start() {
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET) return false;
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port        = htons((unsigned short)o.sinkPort);
+        if (::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listener, SOMAXCONN) != 0)
+            return false;
+
+        acceptThread = std::thread([this] { acceptLoop(); });
+        return true;
+    }
+
+    void stop() {
+        if (stopping.exchange(true)) return;
+        if (acceptThread.joinable()) acceptThread.join();
+        closeSocket(listener);
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& c : connections) {
+            ::shutdown(c.socket, 2);
+            if (c.thread.joinable()) c.thread.join();
+            closeSocket(c.socket);
+        }
+        connections.clear();
+    }
+
+private:
+    const Options& o;
+    Ledger& ledger;
+    Verdicts& v;
+    socket_t listener = INVALID_SOCKET;
+    std::atomic<bool> stopping{false};
+    std::thread acceptThread;
+
+    struct Connection {
+        socket_t socket;
+        std::thread thread;
+    };
+    std::mutex mtx;
+    std::vector<Connection> connections;    // pocas: una por handle de impresora
+
+    static void closeSocket(socket_t s) {
+        if (s == INVALID_SOCKET) return;
+#ifdef _WIN32
+        closesocket(s);
+#else
+        ::close(s);
+#endif
+    }
+
+    static bool readAll(socket_t s, char* out, size_t n) {
+        while (n > 0) {
+            auto r = ::recv(s, out, (int)n, 0);
+            if (r <= 0) return false;
+            out += r;
+            n -= (size_t)r;
+        }
+        return true;
+    }
+
+    void acceptLoop() {
+        while (!stopping) {
+#ifdef _WIN32
+            WSAPOLLFD pfd{listener, POLLIN, 0};
+            if (WSAPoll(&pfd, 1, 200) <= 0) continue;
+#else
+            pollfd pfd{listener, POLLIN, 0};
+            if (::poll(&pfd, 1, 200) <= 0) continue;
+#endif
+            socket_t s = ::accept(listener, nullptr, nullptr);
+            if (s == INVALID_SOCKET) continue;
+            std::lock_guard<std::mutex> lock(mtx);
+            connections.push_back({s, std::thread([this, s] { serve(s); })});
+        }
+    }
+
+    // Etiqueta masiva interrumpida por un urgente: el agente cierra el
+    // documento sin el corte y la retoma en otro, reenviando el encabezado.
+    // Hay a lo sumo una por conexión (un handle, un worker). Si se cortó
+    // justo después del encabezado todavía no se sabe de qué trabajo es.
+    struct Pending {
+        bool open = false;
+        uint64_t seq = 0;       // 0 = sólo llegó el encabezado
+        std::string bytes;      // lo recibido hasta ahora, con un solo encabezado
+    };
+
+    // [largo u32][bytes]... y largo 0 al cerrar cada documento
+    void serve(socket_t s) {
+        std::string doc, frame;
+        Pending pending;
+        for (;;) {
+            unsigned char len[4];
+            if (!readAll(s, (char*)len, 4)) break;
+            const size_t n = len[0] | len[1] << 8 | len[2] << 16 | (size_t)len[3] << 24;
+            if (n == 0) {
+                verify(doc, pending);
+                doc.clear();
+                continue;
+            }
+            frame.resize(n);
+            if (!readAll(s, &frame[0], n)) break;
+            doc += frame;
+        }
+        if (!doc.empty() || pending.open) {
+            v.truncated++;
+            problem("documento cortado (" + std::to_string(doc.size() + pending.bytes.size()) + " bytes)");
+        }
+    }
+
+    void problem(const std::string& what) {
+        std::lock_guard<std::mutex> lock(v.mtx);
+        if (v.samples.size() < 20) v.samples.push_back(what);
+    }
+
+    // Un documento es uno o más trabajos (tandas), cada uno desde su ESC @
+    void verify(const std::string& doc, Pending& pending) {
+        v.docs++;
+        v.bytes += doc.size();
+        static const std::string INIT = "\x1B\x40";
+        size_t pos = doc.find(INIT);
+        if (pos != 0) {
+            v.corrupt++;
+            problem("documento sin ESC @ al principio");
+            if (pos == std::string::npos) return;
+        }
+        while (pos != std::string::npos) {
+            size_t next = doc.find(INIT, pos + 2);
+            check(doc.substr(pos, next == std::string::npos ? std::string::npos : next - pos), pending);
+            pos = next;
+        }
+    }
+
+    void check(const std::string& piece, Pending& pending) {
+        static const std::string CUT("\x1D\x56\x00", 3);
+        const size_t HEAD = 5;                  // ESC @ + ESC a n
+
+        // La primera línea identifica al trabajo: "SOAK T 123" / "SOAK B 123".
+        // La continuación de una etiqueta puede venir sin ninguna (sólo el
+        // encabezado y el corte)
+        static const std::string LABEL_HEAD("\x1B\x40\x1B\x61\x01", HEAD);
+        uint64_t seq = 0;
+        char kind = 0;
+        if (piece.size() < HEAD ||
+            std::sscanf(piece.c_str() + HEAD, "SOAK %c %llu", &kind, (unsigned long long*)&seq) != 2)
+        {
+            if (piece == LABEL_HEAD && !pending.open) {
+                pending.open = true;
+                return;
+            }
+            if (!pending.seq || piece.size() < HEAD) {
+                v.corrupt++;
+                problem("trabajo sin identificar: " + printable(piece));
+                return;
+            }
+            seq = pending.seq;
+        }
+
+        std::string bytes;
+        if (pending.open && (pending.seq == seq || (!pending.seq && kind == 'B'))) {
+            bytes = pending.seq ? std::move(pending.bytes) + piece.substr(HEAD) : piece;
+            pending = Pending();
+        } else {
+            bytes = piece;
+        }
+
+        const Job job = makeJob(seq, o);
+        const bool complete = bytes.size() >= CUT.size() &&
+                              bytes.compare(bytes.size() - CUT.size(), CUT.size(), CUT) == 0;
+        if (!complete && !job.ticket && !pending.open && job.expected.compare(0, bytes.size(), bytes) == 0) {
+            pending.open = true;
+            pending.seq = seq;
+            pending.bytes = std::move(bytes);
+            return;
+        }
+
+        uint8_t before = 0;
+        if (!ledger.mark(seq, Ledger::RECEIVED, before) || !(before & Ledger::SENT)) {
+            v.unexpected++;
+            problem("trabajo " + std::to_string(seq) + " nunca mandado");
+            return;
+        }
+        if (before & Ledger::RECEIVED) {
+            v.duplicate++;
+            problem("trabajo " + std::to_string(seq) + " duplicado");
+            return;
+        }
+        if (bytes != job.expected) {
+            v.corrupt++;
+            problem("trabajo " + std::to_string(seq) + " distinto: " + printable(bytes));
+            return;
+        }
+        v.ok++;
+    }
+
+    static std::string printable(const std::string& s) {
+        std::string out;
+        for (char c : s.substr(0, 80)) out += (c >= 0x20 && c < 0x7F) ? c : '.';
+        return out;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Lado que manda
+// ---------------------------------------------------------------------------
+
+// Lo medido por un hilo en el intervalo en curso
+struct Window {
+    std::mutex mtx;
+    LatencyHistogram latency;
+    uint64_t ok = 0;
+    uint64_t failed = 0;
+};
+
+void sender(int id, const Options& o, Ledger& ledger, std::atomic<uint64_t>& next,
+            std::atomic<bool>& stop, Window& w, std::atomic<uint64_t>& acked)
+{
+    httplib::Client cli(o.host, o.port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+    cli.set_read_timeout(120, 0);
+    httplib::Headers headers = {{"X-Client-Id", "soak-" + std::to_string(id)}};
+
+    while (!stop) {
+        const uint64_t seq = next++;
+        Job job = makeJob(seq, o);
+        uint8_t before;
+        ledger.mark(seq, Ledger::SENT, before);
+
+        const auto t0 = Clock::now();
+        auto res = cli.Post(job.ticket ? "/print/ticket" : "/print/barcode", headers, job.body,
+                            "application/json");
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+
+        const bool ok = res && res->status == 200 && res->body.find("\"success\":true") != std::string::npos;
+        ledger.mark(seq, ok ? Ledger::ACKED : Ledger::FAILED, before);
+        if (ok) acked++;
+
+        std::lock_guard<std::mutex> lock(w.mtx);
+        if (ok) {
+            w.ok++;
+            w.latency.record((uint64_t)us);
+        } else {
+            w.failed++;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Memoria del agente
+// ---------------------------------------------------------------------------
+
+// live_bytes de /debug/allocs; -1 si el agente no cuenta asignaciones
+int64_t agentLiveBytes(const Options& o) {
+    httplib::Client cli(o.host, o.port);
+    auto res = cli.Get("/debug/allocs");
+    if (!res || res->status != 200) return -1;
+    json j = json::parse(res->body, nullptr, false);
+    if (!j.is_object() || !j.value("enabled", false)) return -1;
+    return j.value("live_bytes", (int64_t)-1);
+}
+
+// VmRSS en bytes; -1 sin --pid o fuera de Linux
+int64_t agentRss(const Options& o) {
+    if (!o.pid) return -1;
+    std::ifstream in("/proc/" + std::to_string(o.pid) + "/status");
+    std::string line;
+    while (std::getline(in, line))
+        if (line.rfind("VmRSS:", 0) == 0) return std::atoll(line.c_str() + 6) * 1024;
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+
+void usage() {
+    std::fprintf(stderr,
+        "uso: printagent-soak [--host 127.0.0.1] [--port 9999] [--threads N] [--duration S]\n"
+        "                     [--interval S] [--sink-port 9300] [--printers a,b]\n"
+        "                     [--tickets PORCENTAJE] [--grace S] [--pid PID] [--json]\n");
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if      (a == "--host")      o.host = value();
+        else if (a == "--port")      o.port = std::atoi(value().c_str());
+        else if (a == "--threads")   o.threads = std::atoi(value().c_str());
+        else if (a == "--duration")  o.duration = std::atof(value().c_str());
+        else if (a == "--interval")  o.interval = std::atof(value().c_str());
+        else if (a == "--sink-port") o.sinkPort = std::atoi(value().c_str());
+        else if (a == "--printers") {
+            std::istringstream in(value());
+            std::string p;
+            while (std::getline(in, p, ',')) if (!p.empty()) o.printers.push_back(p);
+        }
+        else if (a == "--tickets")   o.ticketWeight = std::clamp(std::atoi(value().c_str()), 0, 100);
+        else if (a == "--grace")     o.grace = std::atof(value().c_str());
+        else if (a == "--pid")       o.pid = std::atoi(value().c_str());
+        else if (a == "--json")      o.asJson = true;
+        else return false;
+    }
+    return o.threads > 0 && o.duration > 0 && o.interval > 0 && o.grace >= 0;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    if (!parseArgs(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+
+    Ledger ledger;
+    Verdicts v;
+    Sink sink(o, ledger, v);
+    if (!sink.start()) {
+        std::fprintf(stderr, "no se pudo escuchar en el puerto %d\n", o.sinkPort);
+        return 2;
+    }
+
+    std::atomic<uint64_t> next{1}, acked{0};
+    std::atomic<bool> stop{false};
+    std::vector<std::unique_ptr<Window>> windows;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < o.threads; i++) {
+        windows.push_back(std::make_unique<Window>());
+        threads.emplace_back(sender, i, std::cref(o), std::ref(ledger), std::ref(next), std::ref(stop),
+                             std::ref(*windows.back()), std::ref(acked));
+    }
+
+    // Un renglón por intervalo; la deriva se ve comparando el primero y el último
+    json intervals = json::array();
+    const auto start = Clock::now();
+    auto elapsed = [&] { return std::chrono::duration<double>(Clock::now() - start).count(); };
+    if (!o.asJson)
+        std::printf("%7s %9s %9s %9s %9s %7s %9s %9s %12s %12s\n", "t(s)", "ok/s", "p50", "p99", "max",
+                    "errores", "verif.", "en vuelo", "live_bytes", "rss");
+
+    for (double t = o.interval; t <= o.duration + 1e-9; t += o.interval) {
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(t)));
+
+        LatencyHistogram h;
+        uint64_t ok = 0, failed = 0;
+        for (auto& w : windows) {
+            std::lock_guard<std::mutex> lock(w->mtx);
+            h.merge(w->latency);
+            ok += w->ok;
+            failed += w->failed;
+            w->latency.reset();
+            w->ok = w->failed = 0;
+        }
+        const uint64_t verified = v.ok + v.corrupt + v.duplicate;
+        const int64_t inFlight = (int64_t)acked.load() - (int64_t)v.ok.load();
+        const int64_t live = agentLiveBytes(o), rss = agentRss(o);
+
+        json row = {{"t_s", t}, {"ok_per_s", ok / o.interval}, {"failed", failed},
+                    {"p50_ms", h.percentile(50) / 1000.0}, {"p99_ms", h.percentile(99) / 1000.0},
+                    {"max_ms", h.max() / 1000.0}, {"verified", verified}, {"in_flight", inFlight},
+                    {"live_bytes", live}, {"rss_bytes", rss}};
+        intervals.push_back(row);
+        if (!o.asJson) {
+            std::printf("%7.0f %9.1f %7.2fms %7.2fms %7.2fms %7llu %9llu %9lld %12lld %12lld\n", t,
+                        ok / o.interval, h.percentile(50) / 1000.0, h.percentile(99) / 1000.0,
+                        h.max() / 1000.0, (unsigned long long)failed, (unsigned long long)verified,
+                        (long long)inFlight, (long long)live, (long long)rss);
+            std::fflush(stdout);
+        }
+    }
+
+    stop = true;
+    for (auto& t : threads) t.join();
+    const uint64_t sent = next - 1;
+
+    // Espera a que llegue todo lo confirmado
+    auto missing = [&] {
+        uint64_t n = 0;
+        for (uint64_t seq = 1; seq <= sent; seq++) {
+            const uint8_t s = ledger.get(seq);
+            if ((s & Ledger::ACKED) && !(s & Ledger::RECEIVED)) n++;
+        }
+        return n;
+    };
+    const auto graceEnd = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(o.grace));
+    uint64_t lost = missing();
+    while (lost && Clock::now() < graceEnd) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        lost = missing();
+    }
+    sink.stop();
+
+    uint64_t failedButPrinted = 0;
+    for (uint64_t seq = 1; seq <= sent; seq++) {
+        const uint8_t s = ledger.get(seq);
+        if ((s & Ledger::FAILED) && (s & Ledger::RECEIVED)) failedButPrinted++;
+    }
+
+    const bool clean = !v.corrupt && !v.duplicate && !v.unexpected && !v.truncated && !lost;
+    json report = {
+        {"duration_s", elapsed()}, {"threads", o.threads}, {"sent", sent}, {"acked", acked.load()},
+        {"documents", v.docs.load()}, {"bytes", v.bytes.load()}, {"verified_ok", v.ok.load()},
+        {"corrupt", v.corrupt.load()}, {"duplicate", v.duplicate.load()},
+        {"unexpected", v.unexpected.load()}, {"truncated", v.truncated.load()}, {"lost", lost},
+        {"failed_but_printed", failedButPrinted}, {"clean", clean}, {"intervals", intervals},
+        {"problems", v.samples},
+    };
+
+    if (intervals.size() >= 2) {
+        const json& first = intervals.front();
+        const json& last = intervals.back();
+        auto drift = [](double a, double b) { return a > 0 ? (b - a) / a * 100.0 : 0.0; };
+        report["drift"] = {
+            {"ok_per_s_pct", drift(first["ok_per_s"], last["ok_per_s"])},
+            {"p99_pct", drift(first["p99_ms"], last["p99_ms"])},
+            {"rss_bytes", last["rss_bytes"].get<int64_t>() - first["rss_bytes"].get<int64_t>()},
+            {"live_bytes", last["live_bytes"].get<int64_t>() - first["live_bytes"].get<int64_t>()},
+        };
+    }
+
+    if (o.asJson) {
+        std::printf("%s\n", report.dump(2).c_str());
+        return clean ? 0 : 1;
+    }
+
+    std::printf("\n%llu mandados, %llu confirmados, %llu documentos (%llu bytes)\n",
+                (unsigned long long)sent, (unsigned long long)acked.load(),
+                (unsigned long long)v.docs.load(), (unsigned long long)v.bytes.load());
+    std::printf("verificados %llu, corruptos %llu, duplicados %llu, inesperados %llu, cortados %llu, "
+                "perdidos %llu\n",
+                (unsigned long long)v.ok.load(), (unsigned long long)v.corrupt.load(),
+                (unsigned long long)v.duplicate.load(), (unsigned long long)v.unexpected.load(),
+                (unsigned long long)v.truncated.load(), (unsigned long long)lost);
+    if (failedButPrinted)
+        std::printf("con error pero impresos: %llu\n", (unsigned long long)failedButPrinted);
+    if (report.contains("drift")) {
+        const json& d = report["drift"];
+        std::printf("deriva primer -> ultimo intervalo: ok/s %+.1f%%, p99 %+.1f%%, rss %+lld, live_bytes %+lld\n",
+                    d["ok_per_s_pct"].get<double>(), d["p99_pct"].get<double>(),
+                    (long long)d["rss_bytes"].get<int64_t>(), (long long)d["live_bytes"].get<int64_t>());
+    }
+    for (auto& p : v.samples) std::printf("  %s\n", p.c_str());
+    std::printf("%s\n", clean ? "OK" : "FALLA");
+    return clean ? 0 : 1;
+}